@@ -0,0 +1,543 @@
+// Benchmarks for the restaurant management system. Build them next to code.cpp with
+//     g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark
+// and run one by name, e.g. "./benchmark index"; run without a name to list them.
+
+#define RMS_NO_MAIN
+#include "code.cpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <numeric>
+#include <random>
+
+using Clock = std::chrono::steady_clock;
+
+// Milliseconds since start
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Value below which the given fraction of the samples fall; sorts the samples
+double percentile(std::vector<double>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(fraction * static_cast<double>(samples.size() - 1) + 0.5);
+    return samples[rank];
+}
+
+// Silences std::cout while in scope; the system reports every operation there
+class Quiet {
+    std::streambuf* saved;
+public:
+    Quiet() : saved(std::cout.rdbuf(nullptr)) {}
+    ~Quiet() {
+        std::cout.rdbuf(saved);
+        std::cout.clear();
+    }
+    Quiet(const Quiet&) = delete;
+    Quiet& operator=(const Quiet&) = delete;
+};
+
+// A fresh system with an admin and a customer logged in
+struct Setup {
+    RestaurantManagementSystem rms;
+    SessionToken admin;
+    SessionToken customer;         // Only customers place orders
+
+    Setup() {
+        Quiet quiet;
+        rms.registerUser(User(1, "admin", "admin", Role::Admin));
+        rms.registerUser(User(2, "customer", "customer", Role::Customer));
+        admin = rms.login("admin", "admin");
+        customer = rms.login("customer", "customer");
+    }
+};
+
+// Indexed stores: cost of adding, looking up and deleting materials by ID as the store grows.
+// Lookups and deletes visit the IDs in random order.
+void benchIndex() {
+    std::cout << "Material store, ns per operation\n";
+    std::cout << std::setw(10) << "rows" << std::setw(10) << "add" << std::setw(10) << "lookup" << std::setw(10) << "delete" << "\n";
+    for (int rows : {1000, 100000, 1000000}) {
+        Setup setup;
+        std::vector<int> ids(rows);
+        std::iota(ids.begin(), ids.end(), 1);
+        std::mt19937 shuffle(42);
+        double addMs, lookupMs, deleteMs;
+        long long checksum = 0;
+        {
+            Quiet quiet;
+            auto start = Clock::now();
+            for (int id : ids) {
+                setup.rms.addMaterial(setup.admin, Material(id, "Material", Money::fromCents(100), 100, 5));
+            }
+            addMs = elapsedMs(start);
+            std::shuffle(ids.begin(), ids.end(), shuffle);
+            start = Clock::now();
+            for (int id : ids) {
+                checksum += setup.rms.getMaterialByID(id).quantity;
+            }
+            lookupMs = elapsedMs(start);
+            std::shuffle(ids.begin(), ids.end(), shuffle);
+            start = Clock::now();
+            for (int id : ids) {
+                setup.rms.deleteMaterial(setup.admin, id);
+            }
+            deleteMs = elapsedMs(start);
+        }
+        std::cout << std::setw(10) << rows << std::fixed << std::setprecision(0);
+        for (double ms : {addMs, lookupMs, deleteMs}) {
+            std::cout << std::setw(10) << ms * 1e6 / rows;
+        }
+        std::cout << (checksum == 100LL * rows ? "" : "  (lookups went wrong)") << "\n";
+        std::cout.unsetf(std::ios::fixed);
+    }
+}
+
+// The layout orders had before they referenced dishes and materials by ID: every order held
+// full copies of its dishes, and every dish full copies of its materials
+namespace deepcopy {
+struct Material {
+    int materialID;
+    std::string name;
+    double price;
+    int quantity;
+    int warningThreshold;
+};
+
+struct Dish {
+    int dishID;
+    std::string name;
+    double price;
+    std::string category;
+    std::vector<Material> ingredients;
+};
+
+struct Order {
+    int orderID;
+    int customerID;
+    std::vector<Dish> dishes;
+    double totalFee;
+    std::string status;
+    std::string paymentMethod;
+};
+}
+
+// Heap bytes a string holds beyond the object itself: none while it fits the small-string buffer
+size_t heapBytes(const std::string& text) {
+    const char* object = reinterpret_cast<const char*>(&text);
+    bool inside = text.data() >= object && text.data() < object + sizeof(text);
+    return inside ? 0 : text.capacity() + 1;
+}
+
+size_t heapBytes(const deepcopy::Material& material) {
+    return heapBytes(material.name);
+}
+
+size_t heapBytes(const deepcopy::Dish& dish) {
+    size_t bytes = heapBytes(dish.name) + heapBytes(dish.category) + dish.ingredients.capacity() * sizeof(deepcopy::Material);
+    for (auto& material : dish.ingredients) {
+        bytes += heapBytes(material);
+    }
+    return bytes;
+}
+
+size_t heapBytes(const deepcopy::Order& order) {
+    size_t bytes = heapBytes(order.status) + heapBytes(order.paymentMethod) + order.dishes.capacity() * sizeof(deepcopy::Dish);
+    for (auto& dish : order.dishes) {
+        bytes += heapBytes(dish);
+    }
+    return bytes;
+}
+
+size_t heapBytes(const Order& order) {
+    return heapBytes(order.paymentMethod) + order.lines.capacity() * sizeof(OrderLine);
+}
+
+// Bytes a history of orders takes: the vector's buffer and what each order holds on the heap
+template <typename T>
+double footprint(const std::vector<T>& history) {
+    size_t bytes = history.capacity() * sizeof(T);
+    for (auto& order : history) {
+        bytes += heapBytes(order);
+    }
+    return static_cast<double>(bytes);
+}
+
+// Memory footprint of a 1M-order history in the deep-copy layout and in the compact one. The
+// menu has 100 dishes of 5 to 8 ingredients out of 200 materials; each order has 1 to 4 dishes.
+void benchMemory() {
+    const int orders = 1000000;
+    std::mt19937 random(7);
+    std::vector<deepcopy::Material> stock;
+    for (int m = 0; m < 200; ++m) {
+        stock.push_back(deepcopy::Material{m + 1, "Material " + std::to_string(m + 1), 1.5, 1000, 10});
+    }
+    std::vector<deepcopy::Dish> deepMenu;
+    std::vector<Dish> menu;
+    for (int d = 0; d < 100; ++d) {
+        std::string name = "House Special No." + std::to_string(100 + d);
+        deepcopy::Dish deep{d + 1, name, 12.5, "Main", {}};
+        std::vector<Ingredient> ingredients;
+        int count = 5 + static_cast<int>(random() % 4);
+        for (int i = 0; i < count; ++i) {
+            const deepcopy::Material& material = stock[random() % stock.size()];
+            deep.ingredients.push_back(material);
+            ingredients.push_back(Ingredient{material.materialID, 1});
+        }
+        deepMenu.push_back(deep);
+        menu.push_back(Dish(d + 1, name, Money::fromCents(1250), "Main", ingredients));
+    }
+    std::vector<std::vector<int>> picks(orders);
+    for (auto& pick : picks) {
+        int count = 1 + static_cast<int>(random() % 4);
+        for (int i = 0; i < count; ++i) {
+            pick.push_back(static_cast<int>(random() % menu.size()));
+        }
+    }
+
+    double deepBytes;
+    {
+        std::vector<deepcopy::Order> history;
+        history.reserve(orders);
+        for (int o = 0; o < orders; ++o) {
+            deepcopy::Order order{o + 1, 1 + o % 1000, {}, 0, "New", "Cash"};
+            for (int d : picks[o]) {
+                order.dishes.push_back(deepMenu[d]);
+                order.totalFee += deepMenu[d].price;
+            }
+            history.push_back(std::move(order));
+        }
+        deepBytes = footprint(history);
+    }
+    double compactBytes;
+    {
+        std::vector<Order> history;
+        history.reserve(orders);
+        for (int o = 0; o < orders; ++o) {
+            std::vector<OrderLine> lines;
+            for (int d : picks[o]) {
+                addOrderLine(lines, menu[d]);
+            }
+            history.push_back(Order(o + 1, 1 + o % 1000, std::move(lines), "Cash"));
+        }
+        compactBytes = footprint(history);
+    }
+    std::cout << "Order history of " << orders << " orders, bytes held (allocator overhead not counted)\n" << std::fixed << std::setprecision(1);
+    std::cout << std::setw(12) << "deep copy" << std::setw(10) << deepBytes / (1 << 20) << " MiB"
+              << std::setw(8) << std::setprecision(0) << deepBytes / orders << " bytes/order\n" << std::setprecision(1);
+    std::cout << std::setw(12) << "compact" << std::setw(10) << compactBytes / (1 << 20) << " MiB"
+              << std::setw(8) << std::setprecision(0) << compactBytes / orders << " bytes/order\n";
+    std::cout << "Compact layout uses " << std::setprecision(1) << deepBytes / compactBytes << "x less\n";
+    std::cout.unsetf(std::ios::fixed);
+}
+
+const char* programPath = "benchmark";  // Path this program was started with
+const char* const STARTUP_SNAPSHOT = "benchmark.snapshot";
+
+// Time one startup: load the snapshot and open its (empty) journal
+void timeStartup() {
+    RestaurantManagementSystem rms;
+    double loadMs;
+    {
+        Quiet quiet;
+        auto start = Clock::now();
+        rms.loadSnapshot(STARTUP_SNAPSHOT);
+        rms.openJournal(std::string(STARTUP_SNAPSHOT) + ".journal", Durability::Batched);
+        loadMs = elapsedMs(start);
+    }
+    std::cout << "Load: " << std::fixed << std::setprecision(0) << loadMs << " ms\n";
+}
+
+// Startup: save a snapshot of 1M orders, then time how long a fresh system takes to load it.
+// Each load runs in a new process, so it pays for a fresh heap the way a restart does.
+void benchStartup() {
+    const int orders = 1000000;
+    double saveMs;
+    {
+        Setup setup;
+        {
+            Quiet quiet;
+            for (int m = 1; m <= 50; ++m) {
+                setup.rms.addMaterial(setup.admin, Material(m, "Material", Money::fromCents(150), 5000000, 10));
+            }
+            for (int d = 1; d <= 100; ++d) {
+                std::vector<Ingredient> ingredients;
+                for (int i = 0; i < 5; ++i) {
+                    ingredients.push_back(Ingredient{1 + (d + i * 7) % 50, 1});
+                }
+                setup.rms.addDish(setup.admin, Dish(d, "Dish " + std::to_string(d), Money::fromCents(1250), "Main", ingredients));
+            }
+            for (int c = 1; c <= 1000; ++c) {
+                setup.rms.addCustomer(setup.admin, Customer(c, "Customer", "555-0100", 0, "Regular"));
+            }
+            for (int o = 1; o <= orders; ++o) {
+                std::vector<OrderLine> lines;
+                for (int d = 0; d < 1 + o % 4; ++d) {
+                    addOrderLine(lines, setup.rms.getDishByID(1 + (o * 7 + d * 13) % 100));
+                }
+                setup.rms.addOrder(setup.customer, Order(o, 1 + o % 1000, lines, "Cash"));
+            }
+        }
+        auto start = Clock::now();
+        setup.rms.saveSnapshot(STARTUP_SNAPSHOT);
+        saveMs = elapsedMs(start);
+    }
+    std::cout << "Snapshot of " << orders << " orders, " << std::filesystem::file_size(STARTUP_SNAPSHOT) / (1 << 20)
+              << " MiB, saved in " << std::fixed << std::setprecision(0) << saveMs << " ms\n" << std::flush;
+    std::cout.unsetf(std::ios::fixed);
+    std::string command = std::string("\"") + programPath + "\" startup-load";
+    for (int run = 0; run < 3; ++run) {
+        if (std::system(command.c_str()) != 0) {
+            std::cout << "Load run failed.\n";
+        }
+    }
+    std::remove(STARTUP_SNAPSHOT);
+    std::remove((std::string(STARTUP_SNAPSHOT) + ".journal").c_str());
+}
+
+// Order placement: latency of addOrder when it reserves stock for every ingredient of every
+// dish, for small orders and for orders of 12 dishes with 6 ingredients each
+void benchReservation() {
+    const int ordersPerSize = 100000;
+    std::cout << "addOrder latency, us\n";
+    std::cout << std::setw(8) << "dishes" << std::setw(14) << "ingredients" << std::setw(8) << "mean"
+              << std::setw(8) << "p50" << std::setw(8) << "p99" << "\n";
+    for (int dishesPerOrder : {1, 4, 12}) {
+        Setup setup;
+        std::vector<double> latencies;
+        {
+            Quiet quiet;
+            for (int m = 1; m <= 200; ++m) {
+                setup.rms.addMaterial(setup.admin, Material(m, "Material", Money::fromCents(150), 5000000, 10));
+            }
+            for (int d = 1; d <= 50; ++d) {
+                std::vector<Ingredient> ingredients;
+                for (int i = 0; i < 6; ++i) {
+                    ingredients.push_back(Ingredient{1 + (d * 11 + i * 29) % 200, 1 + i % 3});
+                }
+                setup.rms.addDish(setup.admin, Dish(d, "Dish " + std::to_string(d), Money::fromCents(1250), "Main", ingredients));
+            }
+            std::vector<Dish> menu;
+            for (int d = 1; d <= 50; ++d) {
+                menu.push_back(setup.rms.getDishByID(d));
+            }
+            for (int o = 1; o <= ordersPerSize; ++o) {
+                std::vector<OrderLine> lines;
+                for (int d = 0; d < dishesPerOrder; ++d) {
+                    addOrderLine(lines, menu[(o + d * 3) % menu.size()]);
+                }
+                Order order(o, 1, std::move(lines), "Cash");
+                auto start = Clock::now();
+                setup.rms.addOrder(setup.customer, std::move(order));
+                latencies.push_back(elapsedMs(start) * 1000);
+            }
+        }
+        double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+        std::cout << std::setw(8) << dishesPerOrder << std::setw(14) << dishesPerOrder * 6 << std::fixed << std::setprecision(1)
+                  << std::setw(8) << mean << std::setw(8) << percentile(latencies, 0.50)
+                  << std::setw(8) << percentile(latencies, 0.99) << "\n";
+        std::cout.unsetf(std::ios::fixed);
+    }
+}
+
+// Concurrent terminals: throughput of a mixed workload, four lookups for every order placed,
+// from 1 to 16 threads sharing one system. Each thread orders under its own range of IDs, so
+// orders spread over the shards.
+void benchThreads() {
+    const auto window = std::chrono::milliseconds(500);
+    std::cout << "Mixed workload (80% lookups, 20% orders), " << std::thread::hardware_concurrency()
+              << " hardware threads\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "ops/s" << std::setw(10) << "speedup" << "\n";
+    double single = 0;
+    for (int threads : {1, 2, 4, 8, 16}) {
+        Setup setup;
+        {
+            Quiet quiet;
+            for (int m = 1; m <= 100; ++m) {
+                setup.rms.addMaterial(setup.admin, Material(m, "Material", Money::fromCents(150), 5000000, 10));
+            }
+            for (int d = 1; d <= 50; ++d) {
+                std::vector<Ingredient> ingredients;
+                for (int i = 0; i < 4; ++i) {
+                    ingredients.push_back(Ingredient{1 + (d * 7 + i * 13) % 100, 1});
+                }
+                setup.rms.addDish(setup.admin, Dish(d, "Dish " + std::to_string(d), Money::fromCents(1250), "Main", ingredients));
+            }
+        }
+        std::atomic<bool> stop{false};
+        std::atomic<long long> total{0};
+        std::vector<std::thread> workers;
+        double elapsed;
+        {
+            Quiet quiet;
+            auto start = Clock::now();
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    long long ops = 0;
+                    int nextOrder = t * 10000000 + 1;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        if (ops % 5 == 4) {
+                            std::vector<OrderLine> lines;
+                            addOrderLine(lines, setup.rms.getDishByID(1 + nextOrder % 50));
+                            addOrderLine(lines, setup.rms.getDishByID(1 + (nextOrder + 17) % 50));
+                            setup.rms.addOrder(setup.customer, Order(nextOrder++, 1, lines, "Cash"));
+                        } else if (ops % 2 == 0) {
+                            setup.rms.getDishByID(1 + static_cast<int>(ops % 50));
+                        } else {
+                            setup.rms.getMaterialByID(1 + static_cast<int>(ops % 100));
+                        }
+                        ops++;
+                    }
+                    total += ops;
+                });
+            }
+            std::this_thread::sleep_for(window);
+            stop = true;
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            elapsed = elapsedMs(start);
+        }
+        double perSecond = total.load() / (elapsed / 1000);
+        if (threads == 1) {
+            single = perSecond;
+        }
+        std::cout << std::setw(8) << threads << std::setw(14) << std::fixed << std::setprecision(0) << perSecond
+                  << std::setw(10) << std::setprecision(2) << perSecond / single << "\n";
+        std::cout.unsetf(std::ios::fixed);
+    }
+}
+
+// Stock contention: 32 threads order the same dish at once, so every order reserves the same
+// two materials. Flour runs out after two thirds of the orders; the rest must be refused
+// without the stock ever going wrong.
+void benchContention() {
+    const int threads = 32;
+    const int ordersPerThread = 5000;
+    const int flour = threads * ordersPerThread * 2 / 3;
+    const int oil = threads * ordersPerThread * 2;
+    Setup setup;
+    {
+        Quiet quiet;
+        setup.rms.addMaterial(setup.admin, Material(1, "Flour", Money::fromCents(100), flour, 5));
+        setup.rms.addMaterial(setup.admin, Material(2, "Oil", Money::fromCents(50), oil, 5));
+        setup.rms.addDish(setup.admin, Dish(1, "Bread", Money::fromCents(300), "Side", {Ingredient{1, 1}, Ingredient{2, 1}}));
+    }
+    std::vector<OrderLine> lines;
+    addOrderLine(lines, setup.rms.getDishByID(1));
+    std::vector<std::vector<double>> latencies(threads);
+    double elapsed;
+    {
+        Quiet quiet;
+        std::vector<std::thread> workers;
+        auto start = Clock::now();
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < ordersPerThread; ++i) {
+                    auto placed = Clock::now();
+                    setup.rms.addOrder(setup.customer, Order(t * ordersPerThread + i + 1, 1, lines, "Cash"));
+                    latencies[t].push_back(elapsedMs(placed) * 1000);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        elapsed = elapsedMs(start);
+    }
+    std::vector<double> all;
+    for (auto& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    int accepted = flour - setup.rms.getMaterialByID(1).quantity;
+    bool consistent = oil - setup.rms.getMaterialByID(2).quantity == accepted && accepted == flour;
+    std::cout << threads << " threads x " << ordersPerThread << " orders of one dish, " << std::thread::hardware_concurrency()
+              << " hardware threads\n" << std::fixed << std::setprecision(0);
+    std::cout << "Accepted " << accepted << " of " << all.size() << " (stock allows " << flour << "), stock "
+              << (consistent ? "consistent" : "WRONG") << "\n";
+    std::cout << "Throughput: " << all.size() / (elapsed / 1000) << " orders/s\n" << std::setprecision(1);
+    std::cout << "Latency us: p50 " << percentile(all, 0.50) << ", p99 " << percentile(all, 0.99)
+              << ", max " << all.back() << "\n";
+    std::cout.unsetf(std::ios::fixed);
+}
+
+// Kitchen simulation: tickets of one line item arrive at a steady rate and every station cooks
+// one at a time. Reports throughput and ticket latency, from arrival until the system hears the
+// item is done, as the stations per kind scale.
+void benchKitchen() {
+    const int tickets = 3000;
+    const auto prepTime = std::chrono::milliseconds(2);
+    const auto arrivalGap = std::chrono::microseconds(100);  // 10000 tickets a second
+    std::cout << "Kitchen: " << tickets << " tickets, one every " << arrivalGap.count() << " us, "
+              << prepTime.count() << " ms per batch, batching off\n";
+    std::cout << std::setw(14) << "stations/kind" << std::setw(14) << "tickets/s"
+              << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << "\n";
+    for (int stationsPerKind : {1, 2, 4, 8, 16}) {
+        std::vector<Clock::time_point> arrived(tickets), finished(tickets);
+        std::atomic<int> done{0};
+        Clock::time_point start;
+        {
+            KitchenScheduler kitchen(stationsPerKind, prepTime, std::chrono::milliseconds(0), 1,
+                                     [&](const std::vector<int>& orderIDs) {
+                                         auto now = Clock::now();
+                                         for (int id : orderIDs) {
+                                             finished[id] = now;
+                                         }
+                                         done += static_cast<int>(orderIDs.size());
+                                     });
+            start = Clock::now();
+            for (int i = 0; i < tickets; ++i) {
+                std::this_thread::sleep_until(start + i * arrivalGap);
+                int dishID = i % 30;
+                arrived[i] = Clock::now();
+                kitchen.submit(PrepTask{i, dishID, 1, static_cast<StationKind>(dishID % 3), {}});
+            }
+            while (done.load() < tickets) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        double totalMs = elapsedMs(start);
+        std::vector<double> latencies;
+        for (int i = 0; i < tickets; ++i) {
+            latencies.push_back(std::chrono::duration<double, std::milli>(finished[i] - arrived[i]).count());
+        }
+        double p50 = percentile(latencies, 0.50), p99 = percentile(latencies, 0.99);
+        std::cout << std::setw(14) << stationsPerKind << std::setw(14) << std::fixed << std::setprecision(0)
+                  << tickets / (totalMs / 1000) << std::setprecision(2) << std::setw(10) << p50
+                  << std::setw(10) << p99 << std::setw(10) << latencies.back() << "\n";
+        std::cout.unsetf(std::ios::fixed);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    programPath = argv[0];
+    if (argc > 1 && std::strcmp(argv[1], "startup-load") == 0) {
+        timeStartup();  // One load run of the startup benchmark
+        return 0;
+    }
+    const std::vector<std::pair<std::string, void (*)()>> benchmarks = {
+        {"contention", benchContention},
+        {"index", benchIndex},
+        {"kitchen", benchKitchen},
+        {"memory", benchMemory},
+        {"reservation", benchReservation},
+        {"startup", benchStartup},
+        {"threads", benchThreads},
+    };
+    for (auto& benchmark : benchmarks) {
+        if (argc > 1 && benchmark.first == argv[1]) {
+            benchmark.second();
+            return 0;
+        }
+    }
+    std::cout << "Usage: benchmark <name>, where name is one of:";
+    for (auto& benchmark : benchmarks) {
+        std::cout << " " << benchmark.first;
+    }
+    std::cout << "\n";
+    return argc > 1 ? 1 : 0;
+}
@@ -2,80 +2,923 @@
 #include <iostream>
 #include <stdexcept>
 #include <vector>
+#include <array>
+#include <deque>
 #include <string>
 #include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <unordered_map>
+#include <set>
+#include <tuple>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <random>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+// Amount of money held as a whole number of cents, so sums are exact
+class Money {
+public:
+    // Largest amount, either way, that one record may carry: a price, a material's stock value,
+    // a dish's ingredient cost or an order's fee. Totals over any number of records then stay
+    // far from overflowing.
+    static constexpr long long MAX_CENTS = 1000000000;
+
+    Money() : cents(0) {}
+
+    // Create an amount from a number of cents
+    static Money fromCents(long long c) {
+        Money m;
+        m.cents = c;
+        return m;
+    }
+
+    // Get the amount as a number of cents
+    long long getCents() const {
+        return cents;
+    }
+
+    // Parse an amount written with at most two decimal places
+    static bool parse(const std::string& text, Money& m);
+
+    Money operator+(Money other) const {
+        if ((other.cents > 0 && cents > std::numeric_limits<long long>::max() - other.cents) ||
+            (other.cents < 0 && cents < std::numeric_limits<long long>::min() - other.cents)) {
+            throw std::overflow_error("Money overflow");
+        }
+        return fromCents(cents + other.cents);
+    }
+
+    Money operator-(Money other) const {
+        if (other.cents == std::numeric_limits<long long>::min()) {
+            throw std::overflow_error("Money overflow");
+        }
+        return *this + fromCents(-other.cents);
+    }
+
+    // Multiply by a count, such as a quantity in stock
+    Money operator*(long long n) const {
+        if (n != 0 && cents != 0 &&
+            (n == std::numeric_limits<long long>::min() || cents == std::numeric_limits<long long>::min() ||
+             std::llabs(cents) > std::numeric_limits<long long>::max() / std::llabs(n))) {
+            throw std::overflow_error("Money overflow");
+        }
+        return fromCents(cents * n);
+    }
+
+    Money& operator+=(Money other) {
+        return *this = *this + other;
+    }
+
+    // Whether the amount is within the per-record limit
+    bool withinLimit() const {
+        return cents >= -MAX_CENTS && cents <= MAX_CENTS;
+    }
+
+    // Add price * count, returning false and leaving the amount unchanged if the result would
+    // be beyond the per-record limit
+    bool addWithinLimit(Money price, int count) {
+        if (!withinLimit() || !price.withinLimit()) {
+            return false;
+        }
+        Money sum = fromCents(cents + price.cents * count);  // Both factors are below 2^31
+        if (!sum.withinLimit()) {
+            return false;
+        }
+        *this = sum;
+        return true;
+    }
+
+    Money& operator-=(Money other) {
+        return *this = *this - other;
+    }
+
+    bool operator==(Money other) const { return cents == other.cents; }
+    bool operator!=(Money other) const { return cents != other.cents; }
+    bool operator<(Money other) const { return cents < other.cents; }
+
+private:
+    long long cents;               // Amount in cents
+};
+
+// Print an amount as units and two decimal places, e.g. 12.50
+inline std::ostream& operator<<(std::ostream& os, Money m) {
+    long long c = m.getCents();
+    unsigned long long magnitude = c < 0 ? 0ULL - static_cast<unsigned long long>(c) : c;
+    if (c < 0) {
+        os << '-';
+    }
+    os << magnitude / 100 << '.' << (magnitude % 100 < 10 ? "0" : "") << magnitude % 100;
+    return os;
+}
+
+// Parse an amount such as 12, 12.5 or 12.50 exactly
+inline bool Money::parse(const std::string& text, Money& m) {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos] == '-';
+        ++pos;
+    }
+    long long units = 0, fraction = 0;
+    int unitDigits = 0, fractionDigits = 0;
+    for (; pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos])); ++pos, ++unitDigits) {
+        if (units > (std::numeric_limits<long long>::max() / 100 - 9) / 10) {
+            return false;
+        }
+        units = units * 10 + (text[pos] - '0');
+    }
+    if (pos < text.size() && text[pos] == '.') {
+        for (++pos; pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos])); ++pos, ++fractionDigits) {
+            if (fractionDigits == 2) {
+                return false;
+            }
+            fraction = fraction * 10 + (text[pos] - '0');
+        }
+    }
+    if (pos != text.size() || unitDigits + fractionDigits == 0) {
+        return false;
+    }
+    if (fractionDigits == 1) {
+        fraction *= 10;
+    }
+    long long total = units * 100 + fraction;
+    m = Money::fromCents(negative ? -total : total);
+    return true;
+}
+
+// Read an amount such as 12, 12.5 or 12.50 exactly; sets failbit on anything else
+inline std::istream& operator>>(std::istream& is, Money& m) {
+    std::string text;
+    if (!(is >> text)) {
+        return is;
+    }
+    if (!Money::parse(text, m)) {
+        is.setstate(std::ios::failbit);
+    }
+    return is;
+}
+
+// Appends fixed-width fields and length-prefixed strings to a byte buffer (native byte order)
+class BinaryWriter {
+public:
+    std::string buffer;            // Encoded bytes
+
+    void putInt32(int32_t value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void putInt64(int64_t value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void putString(const std::string& value) {
+        putInt32(static_cast<int32_t>(value.size()));
+        buffer.append(value);
+    }
+};
+
+// Layout version of the records written by serialize(); older layouts are still readable
+constexpr int32_t RECORD_FORMAT_VERSION = 4;
+
+// Reads fields written by BinaryWriter straight out of a memory range
+class BinaryReader {
+public:
+    int32_t formatVersion = RECORD_FORMAT_VERSION;  // Layout version of the records being read
+
+    BinaryReader(const char* data, size_t size) : cursor(data), end(data + size) {}
+
+    int32_t getInt32() {
+        int32_t value;
+        take(&value, sizeof(value));
+        return value;
+    }
+
+    int64_t getInt64() {
+        int64_t value;
+        take(&value, sizeof(value));
+        return value;
+    }
+
+    std::string getString() {
+        int32_t size = getInt32();
+        if (size < 0 || size > end - cursor) {
+            throw std::runtime_error("Corrupt record");
+        }
+        std::string value(cursor, size);
+        cursor += size;
+        return value;
+    }
+
+    // Number of bytes not read yet
+    size_t remaining() const {
+        return end - cursor;
+    }
+
+private:
+    const char* cursor;            // Next byte to read
+    const char* end;               // One past the last byte
+
+    void take(void* out, size_t size) {
+        if (size > remaining()) {
+            throw std::runtime_error("Corrupt record");
+        }
+        std::memcpy(out, cursor, size);
+        cursor += size;
+    }
+};
+
+// Read-only view of a whole file, memory-mapped where the platform allows it
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                mappedData = static_cast<const char*>(mapped);
+                mappedSize = info.st_size;
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (file) {
+            fallback.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            mappedData = fallback.data();
+            mappedSize = fallback.size();
+        }
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mappedData != nullptr) {
+            ::munmap(const_cast<char*>(mappedData), mappedSize);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return mappedData != nullptr; }
+    const char* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+
+private:
+    const char* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    std::string fallback;
+#endif
+};
+
+// Write a whole file and fsync it, so it is on disk before anything refers to it
+inline bool writeFileDurably(const std::string& path, const std::string& data) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size() && std::fflush(file) == 0;
+#ifndef _WIN32
+    ok = ok && ::fsync(fileno(file)) == 0;
+#else
+    ok = ok && ::_commit(_fileno(file)) == 0;
+#endif
+    return std::fclose(file) == 0 && ok;
+}
+
+// Make a rename or creation in the directory of path durable (a no-op where directories
+// cannot be synced)
+inline bool syncDirectoryOf(const std::string& path) {
+#ifndef _WIN32
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+// Fill a buffer from the operating system's cryptographically secure generator
+inline bool secureRandom(void* buffer, size_t size) {
+#ifndef _WIN32
+    int fd = ::open("/dev/urandom", O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    char* out = static_cast<char*>(buffer);
+    while (size > 0) {
+        ssize_t got = ::read(fd, out, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            ::close(fd);
+            return false;
+        }
+        out += got;
+        size -= static_cast<size_t>(got);
+    }
+    ::close(fd);
+    return true;
+#else
+    // The Microsoft library draws std::random_device from the system's secure generator
+    std::random_device device;
+    unsigned char* out = static_cast<unsigned char*>(buffer);
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = static_cast<unsigned char>(device());
+    }
+    return true;
+#endif
+}
+
+// How hard the journal works to make a record durable before the call returns
+enum class Durability {
+    EveryOp,                       // fsync after every record
+    Batched,                       // group commit: one fsync covers every record written meanwhile
+    OSBuffered                     // hand records to the OS and never fsync
+};
+
+// Parse a durability level name (every, batched, buffered)
+inline bool parseDurability(const std::string& name, Durability& durability) {
+    if (name == "every") {
+        durability = Durability::EveryOp;
+    } else if (name == "batched") {
+        durability = Durability::Batched;
+    } else if (name == "buffered") {
+        durability = Durability::OSBuffered;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Append-only write-ahead journal of length-prefixed, checksummed records
+class Journal {
+public:
+    ~Journal() {
+        close();
+    }
+
+    // Open the journal for appending; records already in it are kept
+    bool open(const std::string& journalPath, Durability level) {
+        close();
+        file = std::fopen(journalPath.c_str(), "ab");
+        if (file == nullptr) {
+            return false;
+        }
+        path = journalPath;
+        durability = level;
+        return true;
+    }
+
+    // Sync anything pending and close the file
+    void close() {
+        std::unique_lock<std::mutex> lock(mutex);
+        durable.wait(lock, [this] { return !syncing; });
+        if (file != nullptr) {
+            syncLocked();
+            std::fclose(file);
+            file = nullptr;
+        }
+        durable.notify_all();
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // Append one record and make it as durable as the configured level requires
+    void append(const std::string& payload) {
+        waitDurable(write(payload));
+    }
+
+    // Append one record without waiting for it to become durable. The returned ticket is passed
+    // to waitDurable later, e.g. once the caller has let go of its locks.
+    uint64_t write(const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == nullptr) {
+            return 0;
+        }
+        writeRecordLocked(payload);
+        if (durability == Durability::OSBuffered) {
+            std::fflush(file);
+        }
+        return ++written;
+    }
+
+    // Wait until the record with the given ticket, and every record before it, is as durable as
+    // the configured level requires. In batched mode the first waiter syncs at once and records
+    // written during that fsync share the next one, so a lone writer never waits for company.
+    void waitDurable(uint64_t ticket) {
+        if (ticket == 0 || durability == Durability::OSBuffered) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        while (synced < ticket && file != nullptr) {
+            if (syncing) {
+                durable.wait(lock);
+            } else if (durability == Durability::EveryOp) {
+                syncLocked();
+            } else {
+                syncGroupLocked(lock);
+            }
+        }
+    }
+
+    // Discard every record, e.g. once they are all contained in a snapshot. Returns false, with
+    // the journal still open and its records kept, if the file could not be emptied.
+    bool truncate() {
+        std::unique_lock<std::mutex> lock(mutex);
+        durable.wait(lock, [this] { return !syncing; });
+        if (file == nullptr) {
+            return true;
+        }
+        std::fflush(file);
+        std::FILE* emptied = std::fopen(path.c_str(), "wb");
+        if (emptied == nullptr) {
+            return false;
+        }
+        std::fclose(file);
+        file = emptied;
+        syncFile(file);  // Make the truncation itself durable
+        synced = written;  // Records still waiting are contained in the snapshot
+        durable.notify_all();
+        return true;
+    }
+
+    // Call apply on each intact record of a journal file and return how many were read.
+    // A torn or corrupt tail left by a crash is cut off so new records follow valid ones.
+    template <typename Apply>
+    static size_t replay(const std::string& journalPath, Apply apply) {
+        size_t count = 0, validBytes = 0;
+        {
+            MappedFile mapped(journalPath);
+            if (!mapped.isOpen()) {
+                return 0;
+            }
+            BinaryReader in(mapped.data(), mapped.size());
+            while (in.remaining() >= 2 * sizeof(int32_t)) {
+                int32_t size = in.getInt32();
+                uint32_t sum = static_cast<uint32_t>(in.getInt32());
+                if (size < 0 || static_cast<size_t>(size) > in.remaining()) {
+                    break;
+                }
+                const char* payload = mapped.data() + (mapped.size() - in.remaining());
+                if (checksum(payload, size) != sum) {
+                    break;
+                }
+                BinaryReader record(payload, size);
+                apply(record);
+                in = BinaryReader(payload + size, in.remaining() - size);
+                validBytes = mapped.size() - in.remaining();
+                count++;
+            }
+            if (validBytes == mapped.size()) {
+                return count;
+            }
+        }
+        std::error_code error;
+        std::filesystem::resize_file(journalPath, validBytes, error);
+        return count;
+    }
+
+private:
+    std::FILE* file = nullptr;
+    std::string path;
+    Durability durability = Durability::Batched;
+    uint64_t written = 0;          // Records written so far
+    uint64_t synced = 0;           // Of those, how many are known to be on disk
+    bool syncing = false;          // A group commit is in an fsync without holding the mutex
+    std::mutex mutex;
+    std::condition_variable durable;  // Signalled whenever synced moves or syncing ends
+
+    // FNV-1a hash used to detect torn or corrupt records
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    void writeRecordLocked(const std::string& payload) {
+        BinaryWriter header;
+        header.putInt32(static_cast<int32_t>(payload.size()));
+        header.putInt32(static_cast<int32_t>(checksum(payload.data(), payload.size())));
+        std::fwrite(header.buffer.data(), 1, header.buffer.size(), file);
+        std::fwrite(payload.data(), 1, payload.size(), file);
+    }
+
+    static void syncFile(std::FILE* handle) {
+#ifndef _WIN32
+        ::fsync(fileno(handle));
+#else
+        ::_commit(_fileno(handle));
+#endif
+    }
+
+    void syncLocked() {
+        if (written == synced || file == nullptr) {
+            return;
+        }
+        std::fflush(file);
+        if (durability != Durability::OSBuffered) {
+            syncFile(file);
+        }
+        synced = written;
+    }
+
+    // Group commit: one fsync covers every record written so far. The mutex is let go during
+    // the fsync so the next group can be written meanwhile.
+    void syncGroupLocked(std::unique_lock<std::mutex>& lock) {
+        uint64_t covered = written;
+        std::fflush(file);
+        syncing = true;
+        lock.unlock();
+        syncFile(file);
+        lock.lock();
+        syncing = false;
+        synced = std::max(synced, covered);
+        durable.notify_all();
+    }
+};
+
+// Streams rows out of a CSV file in fixed-size chunks instead of loading it whole.
+// Fields may be quoted ("a, b"), with "" standing for a quote inside a quoted field.
+class CsvReader {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    explicit CsvReader(const std::string& path) : file(path, std::ios::binary), chunk(CHUNK_SIZE) {}
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    // Read the next row into fields; returns false at end of file
+    bool nextRow(std::vector<std::string>& fields) {
+        std::string line;
+        if (!nextLine(line)) {
+            return false;
+        }
+        fields.clear();
+        std::string field;
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); ++i) {
+            char ch = line[i];
+            if (quoted) {
+                if (ch == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                    field += '"';
+                    ++i;
+                } else if (ch == '"') {
+                    quoted = false;
+                } else {
+                    field += ch;
+                }
+            } else if (ch == '"') {
+                quoted = true;
+            } else if (ch == ',') {
+                fields.push_back(field);
+                field.clear();
+            } else {
+                field += ch;
+            }
+        }
+        fields.push_back(field);
+        return true;
+    }
+
+private:
+    std::ifstream file;
+    std::vector<char> chunk;       // Buffer the file is read into
+    size_t chunkPos = 0;           // Next unread byte in chunk
+    size_t chunkLen = 0;           // Number of valid bytes in chunk
+
+    // Read the next line, without its line ending, refilling the chunk as needed
+    bool nextLine(std::string& line) {
+        line.clear();
+        bool any = false;
+        for (;;) {
+            if (chunkPos == chunkLen) {
+                file.read(chunk.data(), chunk.size());
+                chunkLen = static_cast<size_t>(file.gcount());
+                chunkPos = 0;
+                if (chunkLen == 0) {
+                    return any;
+                }
+            }
+            any = true;
+            const char* start = chunk.data() + chunkPos;
+            const char* newline = static_cast<const char*>(std::memchr(start, '\n', chunkLen - chunkPos));
+            if (newline == nullptr) {
+                line.append(start, chunkLen - chunkPos);
+                chunkPos = chunkLen;
+                continue;
+            }
+            line.append(start, newline - start);
+            chunkPos += (newline - start) + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return true;
+        }
+    }
+};
+
+// Parse a whole string as an int
+inline bool parseInt(const std::string& text, int& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || errno != 0 || parsed < std::numeric_limits<int>::min() || parsed > std::numeric_limits<int>::max()) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
 
 // Class representing a material used in dishes
 class Material {
 public:
     int materialID;                // Unique identifier for the material
     std::string name;              // Name of the material
-    double price;                  // Price of the material
+    Money price;                   // Price of the material
     int quantity;                  // Quantity of the material in stock
     int warningThreshold;          // Threshold for low stock warning
+    bool lowStockWarned;           // A stock warning was sent and the material has not been restocked since
+    long long revision;            // Bumped on every journaled change; replay keeps the newest revision
 
     // Constructor to initialize the material with given parameters
-    Material(int id, std::string n, double p, int q, int wt) 
-        : materialID(id), name(n), price(p), quantity(q), warningThreshold(wt) {}
+    Material(int id, std::string n, Money p, int q, int wt) 
+        : materialID(id), name(n), price(p), quantity(q), warningThreshold(wt), lowStockWarned(false), revision(0) {}
+
+    // Check whether the stock has fallen to the warning threshold
+    bool isLowStock() const {
+        return quantity <= warningThreshold;
+    }
+
+    // Write the material to a binary record
+    void serialize(BinaryWriter& out) const {
+        out.putInt32(materialID);
+        out.putString(name);
+        out.putInt64(price.getCents());
+        out.putInt32(quantity);
+        out.putInt32(warningThreshold);
+        out.putInt64(revision);
+    }
+
+    // Read a material from a binary record
+    static Material deserialize(BinaryReader& in) {
+        int id = in.getInt32();
+        std::string n = in.getString();
+        Money p = Money::fromCents(in.getInt64());
+        int q = in.getInt32();
+        int wt = in.getInt32();
+        Material material(id, n, p, q, wt);
+        material.lowStockWarned = material.isLowStock();  // Warned before it was saved
+        material.revision = in.formatVersion >= 4 ? in.getInt64() : 0;
+        return material;
+    }
 
     // Display material information
-    void display() {
+    void display() const {
         std::cout << "Material ID: " << materialID << ", Name: " << name 
                   << ", Price: " << price << ", Quantity: " << quantity 
                   << ", Warning Threshold: " << warningThreshold << std::endl;
     }
 };
 
+// Stock level of one material, on a cache line of its own so orders taking different
+// materials never contend on the same line
+struct alignas(64) StockCounter {
+    std::atomic<int> quantity;     // Units in stock
+
+    explicit StockCounter(int q) : quantity(q) {}
+
+    // Take units out of stock (or return them, when negative) unless stock would run short
+    bool take(int amount) {
+        int current = quantity.load(std::memory_order_relaxed);
+        do {
+            if (amount > current) {
+                return false;
+            }
+        } while (!quantity.compare_exchange_weak(current, current - amount, std::memory_order_acq_rel,
+                                                 std::memory_order_relaxed));
+        return true;
+    }
+};
+
+// One line of a recipe: a material and how much of it one serving uses
+struct Ingredient {
+    int materialID;                // Material ID of the ingredient
+    int amount;                    // Units of the material used per serving
+};
+
 // Class representing a dish which includes multiple materials
 class Dish {
 public:
     int dishID;                    // Unique identifier for the dish
     std::string name;              // Name of the dish
-    double price;                  // Price of the dish
+    Money price;                   // Price of the dish
     std::string category;          // Category of the dish
-    std::vector<Material> ingredients;  // Ingredients used in the dish
+    std::vector<Ingredient> ingredients;  // Ingredients used in one serving of the dish
+    Money ingredientCost;          // Cost of the ingredients of one serving, kept up to date by the system
 
     // Constructor to initialize the dish with given parameters
-    Dish(int id, std::string n, double p, std::string c, std::vector<Material> ing) 
+    Dish(int id, std::string n, Money p, std::string c, std::vector<Ingredient> ing) 
         : dishID(id), name(n), price(p), category(c), ingredients(ing) {}
 
-    // Display dish information along with its ingredients
-    void display() {
-        std::cout << "Dish ID: " << dishID << ", Name: " << name 
-                  << ", Price: " << price << ", Category: " << category << std::endl;
-        std::cout << "Ingredients: " << std::endl;
+    // Get the margin of the dish: its price minus its ingredient cost
+    Money getMargin() const {
+        return price - ingredientCost;
+    }
+
+    // Write the dish to a binary record
+    void serialize(BinaryWriter& out) const {
+        out.putInt32(dishID);
+        out.putString(name);
+        out.putInt64(price.getCents());
+        out.putString(category);
+        out.putInt32(static_cast<int32_t>(ingredients.size()));
         for (auto& ingredient : ingredients) {
-            ingredient.display();
+            out.putInt32(ingredient.materialID);
+            out.putInt32(ingredient.amount);
+        }
+    }
+
+    // Read a dish from a binary record
+    static Dish deserialize(BinaryReader& in) {
+        int id = in.getInt32();
+        std::string n = in.getString();
+        Money p = Money::fromCents(in.getInt64());
+        std::string c = in.getString();
+        int count = in.getInt32();
+        if (count < 0 || static_cast<size_t>(count) > in.remaining() / sizeof(int32_t)) {
+            throw std::runtime_error("Corrupt record");
         }
+        std::vector<Ingredient> ing(count);
+        for (auto& ingredient : ing) {
+            ingredient.materialID = in.getInt32();
+            ingredient.amount = in.formatVersion >= 2 ? in.getInt32() : 1;  // Version 1 had no amounts
+        }
+        return Dish(id, n, p, c, ing);
+    }
+
+    // Display dish information (ingredients are resolved by the system)
+    void display() const {
+        std::cout << "Dish ID: " << dishID << ", Name: " << name 
+                  << ", Price: " << price << ", Category: " << category << std::endl;
+    }
+};
+
+// Roles a user can hold
+enum class Role : unsigned char { Admin, Chef, Customer };
+
+// Parse a role name, returning false if it is not Admin, Chef or Customer
+inline bool parseRole(const std::string& name, Role& role) {
+    if (name == "Admin") {
+        role = Role::Admin;
+    } else if (name == "Chef") {
+        role = Role::Chef;
+    } else if (name == "Customer") {
+        role = Role::Customer;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Get the display name of a role
+inline const char* roleName(Role role) {
+    switch (role) {
+        case Role::Admin: return "Admin";
+        case Role::Chef: return "Chef";
+        case Role::Customer: return "Customer";
     }
+    return "Unknown";
+}
+
+// Capabilities checked by the system; a session holds them as a bitmask
+enum Permission : unsigned {
+    ManageUsers         = 1u << 0,
+    ManageMaterials     = 1u << 1,
+    ViewMaterials       = 1u << 2,
+    ManageDishes        = 1u << 3,
+    ManageCustomers     = 1u << 4,
+    ManageOrders        = 1u << 5,   // Display, modify and delete orders
+    PlaceOrders         = 1u << 6,
+    Checkout            = 1u << 7,
+    ManageNotifications = 1u << 8,
+    ViewFinance         = 1u << 9,
+    ManageSystem        = 1u << 10,  // Save snapshots
+    PrepareOrders       = 1u << 11   // Work the kitchen queue
 };
 
+// Opaque token naming a login session
+using SessionToken = std::uint64_t;
+constexpr SessionToken NO_SESSION = 0;    // Never issued; returned when a login fails
+
+// Get the permission bitmask granted to a role
+inline unsigned permissionsFor(Role role) {
+    switch (role) {
+        case Role::Admin:
+            return ManageUsers | ManageMaterials | ViewMaterials | ManageDishes | ManageCustomers
+                 | ManageOrders | ManageNotifications | ViewFinance | ManageSystem | PrepareOrders;
+        case Role::Chef:
+            return ViewMaterials | ManageDishes | PrepareOrders;
+        case Role::Customer:
+            return PlaceOrders | Checkout;
+    }
+    return 0;
+}
+
 // Class representing a user of the system
 class User {
 public:
     int userID;                    // Unique identifier for the user
     std::string username;          // Username for login
     std::string password;          // Password for login
-    std::string role;              // Role of the user (Admin, Chef, Customer)
+    Role role;                     // Role of the user (Admin, Chef, Customer)
 
     // Constructor to initialize the user with given parameters
-    User(int id, std::string u, std::string p, std::string r) 
+    User(int id, std::string u, std::string p, Role r) 
         : userID(id), username(u), password(p), role(r) {}
 
+    // Write the user to a binary record
+    void serialize(BinaryWriter& out) const {
+        out.putInt32(userID);
+        out.putString(username);
+        out.putString(password);
+        out.putInt32(static_cast<int32_t>(role));
+    }
+
+    // Read a user from a binary record
+    static User deserialize(BinaryReader& in) {
+        int id = in.getInt32();
+        std::string u = in.getString();
+        std::string p = in.getString();
+        int r = in.getInt32();
+        if (r < static_cast<int>(Role::Admin) || r > static_cast<int>(Role::Customer)) {
+            throw std::runtime_error("Corrupt record");
+        }
+        return User(id, u, p, static_cast<Role>(r));
+    }
+
     // Login function to check username and password
     bool login(std::string uname, std::string pwd) {
         return username == uname && password == pwd;
     }
 
     // Get the role of the user
-    std::string getRole() {
+    Role getRole() const {
         return role;
     }
 
     // Display user information
     void display() {
         std::cout << "User ID: " << userID << ", Username: " << username 
-                  << ", Role: " << role << std::endl;
+                  << ", Role: " << roleName(role) << std::endl;
     }
 };
 
@@ -92,6 +935,25 @@ public:
     Customer(int id, std::string n, std::string c, int p, std::string d) 
         : customerID(id), name(n), contact(c), points(p), discountInfo(d) {}
 
+    // Write the customer to a binary record
+    void serialize(BinaryWriter& out) const {
+        out.putInt32(customerID);
+        out.putString(name);
+        out.putString(contact);
+        out.putInt32(points);
+        out.putString(discountInfo);
+    }
+
+    // Read a customer from a binary record
+    static Customer deserialize(BinaryReader& in) {
+        int id = in.getInt32();
+        std::string n = in.getString();
+        std::string c = in.getString();
+        int p = in.getInt32();
+        std::string d = in.getString();
+        return Customer(id, n, c, p, d);
+    }
+
     // Display customer information
     void display() {
         std::cout << "Customer ID: " << customerID << ", Name: " << name 
@@ -100,44 +962,161 @@ public:
     }
 };
 
-// Class representing an order made by a customer
-class Order {
-public:
+// A single line of an order: which dish, how many, and its price when ordered
+struct OrderLine {
+    int dishID;                    // Dish ID of the ordered dish
+    int quantity;                  // Number of servings ordered
+    Money price;                   // Unit price of the dish when the order was placed
+};
+
+// Add one serving of a dish to a list of order lines, merging repeats of the same dish
+inline void addOrderLine(std::vector<OrderLine>& lines, const Dish& dish) {
+    for (auto& line : lines) {
+        if (line.dishID == dish.dishID) {
+            line.quantity++;
+            return;
+        }
+    }
+    lines.push_back(OrderLine{dish.dishID, 1, dish.price});
+}
+
+// Lifecycle of an order: New -> InPreparation -> Completed
+enum class OrderStatus : unsigned char { New, InPreparation, Completed };
+
+// Parse an order status, accepting the display name or the one-word form
+inline bool parseOrderStatus(const std::string& name, OrderStatus& status) {
+    if (name == "New") {
+        status = OrderStatus::New;
+    } else if (name == "InPreparation" || name == "In Preparation") {
+        status = OrderStatus::InPreparation;
+    } else if (name == "Completed") {
+        status = OrderStatus::Completed;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Get the display name of an order status
+inline const char* statusName(OrderStatus status) {
+    switch (status) {
+        case OrderStatus::New: return "New";
+        case OrderStatus::InPreparation: return "In Preparation";
+        case OrderStatus::Completed: return "Completed";
+    }
+    return "Unknown";
+}
+
+// Check whether an order may move from one status to another; orders only move forward, one step at a time
+inline bool isValidTransition(OrderStatus from, OrderStatus to) {
+    return (from == OrderStatus::New && to == OrderStatus::InPreparation)
+        || (from == OrderStatus::InPreparation && to == OrderStatus::Completed);
+}
+
+// Class representing an order made by a customer
+class Order {
+public:
     int orderID;                   // Unique identifier for the order
     int customerID;                // Customer ID who placed the order
-    std::vector<Dish> dishes;      // List of dishes in the order
-    double totalFee;               // Total fee for the order
-    std::string status;            // Status of the order (New, In Preparation, Completed)
+    std::vector<OrderLine> lines;  // Dishes in the order
+    Money totalFee;                // Total fee for the order
+    OrderStatus status;            // Lifecycle state of the order
     std::string paymentMethod;     // Payment method for the order
+    int priority;                  // Kitchen priority, higher is prepared first
+    long long sequence;            // Placement order given by the system, older orders are prepared first
+    bool paid;                     // Settled at checkout; independent of the kitchen status
 
     // Constructor to initialize the order with given parameters
-    Order(int id, int cid, std::vector<Dish> d, std::string pm) 
-        : orderID(id), customerID(cid), dishes(d), paymentMethod(pm), status("New") {
-        totalFee = calculateTotalFee();  // Calculate the total fee for the order
+    Order(int id, int cid, std::vector<OrderLine> l, std::string pm) 
+        : orderID(id), customerID(cid), lines(l), status(OrderStatus::New), paymentMethod(pm), priority(0), sequence(0),
+          paid(false) {
+        calculateTotalFee(totalFee);  // Orders whose fee is beyond the limit are refused when placed
     }
 
-    // Calculate the total fee for the order
-    double calculateTotalFee() {
-        double total = 0;
-        for (auto& dish : dishes) {
-            total += dish.price;
+    // Write the order to a binary record
+    void serialize(BinaryWriter& out) const {
+        out.putInt32(orderID);
+        out.putInt32(customerID);
+        out.putInt32(static_cast<int32_t>(lines.size()));
+        for (auto& line : lines) {
+            out.putInt32(line.dishID);
+            out.putInt32(line.quantity);
+            out.putInt64(line.price.getCents());
         }
-        return total;
+        out.putInt32(static_cast<int32_t>(status));
+        out.putString(paymentMethod);
+        out.putInt32(priority);
+        out.putInt64(sequence);
+        out.putInt32(paid);
+    }
+
+    // Read an order from a binary record
+    static Order deserialize(BinaryReader& in) {
+        int id = in.getInt32();
+        int cid = in.getInt32();
+        int count = in.getInt32();
+        if (count < 0 || static_cast<size_t>(count) > in.remaining() / 16) {
+            throw std::runtime_error("Corrupt record");
+        }
+        std::vector<OrderLine> l(count);
+        for (auto& line : l) {
+            line.dishID = in.getInt32();
+            line.quantity = in.getInt32();
+            line.price = Money::fromCents(in.getInt64());
+        }
+        OrderStatus st = OrderStatus::New;
+        if (in.formatVersion >= 3) {
+            int32_t value = in.getInt32();
+            if (value < 0 || value > static_cast<int32_t>(OrderStatus::Completed)) {
+                throw std::runtime_error("Corrupt record");
+            }
+            st = static_cast<OrderStatus>(value);
+        } else if (!parseOrderStatus(in.getString(), st)) {
+            st = OrderStatus::New;  // Older versions stored free-form text; only "New" was ever written
+        }
+        std::string pm = in.getString();
+        Order order(id, cid, l, pm);
+        order.status = st;
+        if (in.formatVersion >= 3) {
+            order.priority = in.getInt32();
+            order.sequence = in.getInt64();
+            order.paid = in.getInt32() != 0;
+        } else {
+            order.paid = st == OrderStatus::Completed;  // Checkout used to treat completed orders as settled
+        }
+        return order;
+    }
+
+    // Calculate the total fee for the order, returning false if it is beyond Money::MAX_CENTS
+    bool calculateTotalFee(Money& total) const {
+        total = Money();
+        for (auto& line : lines) {
+            if (!total.addWithinLimit(line.price, line.quantity)) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    // Update the status of the order
-    void updateStatus(std::string newStatus) {
+    // Move the order to a new status, returning false if the transition is not allowed
+    bool updateStatus(OrderStatus newStatus) {
+        if (!isValidTransition(status, newStatus)) {
+            return false;
+        }
         status = newStatus;
+        return true;
     }
 
     // Display order information along with its dishes
-    void display() {
+    void display() const {
         std::cout << "Order ID: " << orderID << ", Customer ID: " << customerID 
-                  << ", Total Fee: " << totalFee << ", Status: " << status 
-                  << ", Payment Method: " << paymentMethod << std::endl;
+                  << ", Total Fee: " << totalFee << ", Status: " << statusName(status) 
+                  << ", Priority: " << priority << ", Payment Method: " << paymentMethod
+                  << ", Paid: " << (paid ? "Yes" : "No") << std::endl;
         std::cout << "Dishes: " << std::endl;
-        for (auto& dish : dishes) {
-            dish.display();
+        for (auto& line : lines) {
+            std::cout << "Dish ID: " << line.dishID << ", Quantity: " << line.quantity 
+                      << ", Price: " << line.price << std::endl;
         }
     }
     
@@ -158,6 +1137,23 @@ public:
     Notification(int id, std::string t, std::string c, std::string tm) 
         : notificationID(id), type(t), content(c), time(tm) {}
 
+    // Write the notification to a binary record
+    void serialize(BinaryWriter& out) const {
+        out.putInt32(notificationID);
+        out.putString(type);
+        out.putString(content);
+        out.putString(time);
+    }
+
+    // Read a notification from a binary record
+    static Notification deserialize(BinaryReader& in) {
+        int id = in.getInt32();
+        std::string t = in.getString();
+        std::string c = in.getString();
+        std::string tm = in.getString();
+        return Notification(id, t, c, tm);
+    }
+
     // Display notification information
     void display() {
         std::cout << "Notification ID: " << notificationID << ", Type: " << type 
@@ -168,26 +1164,41 @@ public:
 // Class representing the financial information of the restaurant
 class Finance {
 public:
-    double totalIncome;            // Total income of the restaurant
-    double totalCost;              // Total cost of the restaurant
-    double grossProfit;            // Gross profit of the restaurant
+    Money totalIncome;             // Total income of the restaurant
+    Money totalCost;               // Total cost of the restaurant
+    Money grossProfit;             // Gross profit of the restaurant
 
     // Constructor to initialize finance with default values
-    Finance() : totalIncome(0), totalCost(0), grossProfit(0) {}
+    Finance() {}
 
-    // Calculate financial information based on orders and materials
-    void calculateFinance(std::vector<Order> orders, std::vector<Material> materials) {
-        totalIncome = 0;
-        for (auto& order : orders) {
-            totalIncome += order.totalFee;
-        }
-        totalCost = 0;
+    // Recalculate financial information from scratch based on the sum of all order fees and the materials
+    void calculateFinance(Money orderFees, const std::vector<Material>& materials) {
+        totalIncome = orderFees;
+        totalCost = Money();
         for (auto& material : materials) {
             totalCost += material.price * material.quantity;
         }
         grossProfit = totalIncome - totalCost;
     }
 
+    // Apply the change of an order's fee (0 for an added or deleted order)
+    void applyOrderDelta(Money oldFee, Money newFee) {
+        totalIncome += newFee - oldFee;
+        grossProfit = totalIncome - totalCost;
+    }
+
+    // Apply the change of a material's stock value (price * quantity)
+    void applyMaterialDelta(Money oldValue, Money newValue) {
+        totalCost += newValue - oldValue;
+        grossProfit = totalIncome - totalCost;
+    }
+
+    // Check whether another set of totals agrees exactly with this one
+    bool matches(const Finance& other) const {
+        return totalIncome == other.totalIncome && totalCost == other.totalCost
+            && grossProfit == other.grossProfit;
+    }
+
     // Display financial information
     void display() {
         std::cout << "Total Income: " << totalIncome << ", Total Cost: " << totalCost 
@@ -195,213 +1206,2960 @@ public:
     }
 };
 
-// Class representing the restaurant management system
-class RestaurantManagementSystem {
+// Maximum servings of every dish that the current stock supports. The recipes are stored
+// column-major (ingredient k of every dish is contiguous) and padded to the longest recipe, so
+// the minimum over ingredients is one branch-free pass over the whole menu that the compiler
+// vectorizes. A stock change only touches the cells of that material and the dishes using it.
+class ServingsTable {
+public:
+    static constexpr int UNLIMITED = std::numeric_limits<int>::max();  // Servings of a dish with no ingredients
+
+    // Lay out the recipes of dishes (by slot) against the current stock of materials
+    void build(const std::vector<Dish>& dishes, const std::vector<Material>& materials,
+               const std::unordered_map<int, size_t>& materialIndex) {
+        dishCount = dishes.size();
+        width = 0;
+        for (auto& dish : dishes) {
+            width = std::max(width, dish.ingredients.size());
+        }
+        stock.assign(width * dishCount, std::numeric_limits<double>::infinity());
+        amount.assign(width * dishCount, 1.0);
+        cellsByMaterial.clear();
+        std::vector<int> columns;         // Material ID of each column used by the current dish
+        for (size_t d = 0; d < dishCount; ++d) {
+            columns.clear();
+            for (auto& ingredient : dishes[d].ingredients) {
+                // A material listed twice in one recipe shares a single cell
+                size_t k = std::find(columns.begin(), columns.end(), ingredient.materialID) - columns.begin();
+                if (k < columns.size()) {
+                    amount[k * dishCount + d] += ingredient.amount;
+                    continue;
+                }
+                size_t cell = k * dishCount + d;
+                columns.push_back(ingredient.materialID);
+                auto material = materialIndex.find(ingredient.materialID);
+                stock[cell] = material == materialIndex.end() ? 0 : std::max(materials[material->second].quantity, 0);
+                amount[cell] = ingredient.amount;
+                cellsByMaterial[ingredient.materialID].push_back(cell);
+            }
+        }
+        servings.assign(dishCount, UNLIMITED);
+        computeAll();
+    }
+
+    // Record a new stock level for one material and recompute the dishes that use it.
+    // Returns whether any of those dishes went in or out of stock.
+    bool setStock(int materialID, int quantity) {
+        auto entry = cellsByMaterial.find(materialID);
+        if (entry == cellsByMaterial.end()) {
+            return false;
+        }
+        bool flipped = false;
+        for (size_t cell : entry->second) {
+            size_t d = cell % dishCount;
+            bool wasAvailable = servings[d] > 0;
+            stock[cell] = std::max(quantity, 0);
+            compute(d);
+            flipped |= wasAvailable != (servings[d] > 0);
+        }
+        return flipped;
+    }
+
+    // Servings available of the dish in the given slot
+    int available(size_t slot) const {
+        return servings[slot];
+    }
+
 private:
-    std::vector<User> users;              // List of users in the system
-    std::vector<Material> materials;      // List of materials in the system
-    std::vector<Dish> dishes;             // List of dishes in the system
-    std::vector<Customer> customers;      // List of customers in the system
-    std::vector<Order> orders;            // List of orders in the system
-    std::vector<Notification> notifications; // List of notifications in the system
-    Finance finance;                      // Financial information of the restaurant
+    size_t dishCount = 0;                 // Number of dishes (length of one column)
+    size_t width = 0;                     // Number of ingredient columns (longest recipe)
+    std::vector<double> stock;            // [k * dishCount + d]: stock of ingredient k of dish d, +inf as padding
+    std::vector<double> amount;           // [k * dishCount + d]: amount per serving of that ingredient, 1 as padding
+    std::vector<int> servings;            // Servings available per dish slot
+    std::unordered_map<int, std::vector<size_t>> cellsByMaterial;  // Material ID -> cells holding its stock
+
+    // Clamp a minimum quotient to a serving count
+    static int toServings(double limit) {
+        return limit >= UNLIMITED ? UNLIMITED : static_cast<int>(limit);
+    }
+
+    // Recompute every dish in one pass per ingredient column
+    void computeAll() {
+        std::vector<double> limit(dishCount, std::numeric_limits<double>::infinity());
+        for (size_t k = 0; k < width; ++k) {
+            const double* s = stock.data() + k * dishCount;
+            const double* a = amount.data() + k * dishCount;
+            for (size_t d = 0; d < dishCount; ++d) {
+                limit[d] = std::min(limit[d], s[d] / a[d]);
+            }
+        }
+        for (size_t d = 0; d < dishCount; ++d) {
+            servings[d] = toServings(limit[d]);
+        }
+    }
+
+    // Recompute a single dish
+    void compute(size_t d) {
+        double limit = std::numeric_limits<double>::infinity();
+        for (size_t k = 0; k < width; ++k) {
+            limit = std::min(limit, stock[k * dishCount + d] / amount[k * dishCount + d]);
+        }
+        servings[d] = toServings(limit);
+    }
+};
+
+// Read-only view of the dishes that can be served right now. A new view is published whenever
+// a dish goes in or out of stock or the menu changes; readers just copy the pointer.
+struct AvailableMenu {
+    std::vector<Dish> dishes;                   // Dishes with at least one serving in stock
+    std::unordered_map<int, size_t> dishIndex;  // Dish ID -> position in dishes
+};
+
+// Orders of one customer not yet settled at checkout, with their running total
+struct CustomerOrders {
+    std::vector<int> unpaidIDs;    // IDs of the unpaid orders, in no particular order
+    Money unpaidTotal;             // Sum of totalFee over the unpaid orders
+};
+
+// Kitchen stations that dishes are prepared at
+enum class StationKind : unsigned char { Grill, Fryer, ColdLine };
+
+// Get the display name of a station kind
+inline const char* stationName(StationKind kind) {
+    switch (kind) {
+        case StationKind::Grill: return "Grill";
+        case StationKind::Fryer: return "Fryer";
+        case StationKind::ColdLine: return "Cold Line";
+    }
+    return "Unknown";
+}
+
+// Station that prepares dishes of a category; anything not fried or cold goes to the grill
+inline StationKind stationFor(const std::string& category) {
+    std::string key;
+    for (char c : category) {
+        key += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (key == "fryer" || key == "fried" || key == "side" || key == "snack") {
+        return StationKind::Fryer;
+    }
+    if (key == "cold" || key == "salad" || key == "starter" || key == "dessert" || key == "drink") {
+        return StationKind::ColdLine;
+    }
+    return StationKind::Grill;
+}
 
-    User* loggedInUser = nullptr;         // Pointer to the logged-in user
+// One line of an order, waiting to be cooked
+struct PrepTask {
+    int orderID;                   // Order the dish belongs to
+    int dishID;                    // Dish to prepare
+    int servings;                  // Number of servings of the dish
+    StationKind kind;              // Station kind that can prepare it
+    std::chrono::steady_clock::time_point queuedAt;  // When the task was handed to the kitchen
+};
+
+// Line items of the same dish, from one or more orders, cooked together by one station
+struct CookBatch {
+    int dishID;                    // Dish cooked by the batch
+    StationKind kind;              // Station kind that can cook it
+    int servings = 0;              // Servings over all the line items
+    std::vector<PrepTask> tasks;   // Line items in the batch
+    std::chrono::steady_clock::time_point opened;  // Arrival of the first line item
+};
 
+// Runs cook batches on one worker thread per station. Line items of the same dish are first
+// held for up to batchWindow so items from several orders can be cooked together; the window
+// starts at the first item, so no item waits longer than that before reaching a station. Each
+// station owns a deque: it works from the front of its own, oldest first, and when that is
+// empty it steals the newest batch from the back of another station of the same kind. Workers
+// never touch the system; they queue finished line items, and a notifier thread hands them to
+// the onFinished callback as soon as they arrive.
+class KitchenScheduler {
 public:
-    // Login function to authenticate a user
-    bool login(std::string username, std::string password) {
-        for (auto& user : users) {
-            if (user.login(username, password)) {
-                loggedInUser = &user;
+    using FinishedHandler = std::function<void(const std::vector<int>&)>;  // Gets order IDs of finished line items
+
+    // Counters reported for one station
+    struct StationStats {
+        StationKind kind;          // Kind of the station
+        long long prepared;        // Batches cooked by the station
+        long long stolen;          // Of those, batches taken from another station
+        size_t queued;             // Batches waiting in the station's own deque
+    };
+
+    // Counters reported for the batching stage
+    struct BatchStats {
+        long long batches = 0;     // Batches sent to the stations
+        long long items = 0;       // Line items in those batches
+        size_t largest = 0;        // Most line items in one batch
+        double totalWaitMs = 0;    // Time line items spent waiting for their batch to close
+        double longestWaitMs = 0;  // Longest such wait of a single line item
+    };
+
+    // A cook takes prepTime per batch, up to maxBatchServings servings; a zero window turns batching off
+    KitchenScheduler(int stationsPerKind, std::chrono::milliseconds prepTime,
+                     std::chrono::milliseconds batchWindow, int maxBatchServings, FinishedHandler onFinished)
+        : prepTime(prepTime), onFinished(std::move(onFinished)), batchWindow(batchWindow),
+          maxBatchServings(maxBatchServings) {
+        for (StationKind kind : {StationKind::Grill, StationKind::Fryer, StationKind::ColdLine}) {
+            for (int i = 0; i < stationsPerKind; ++i) {
+                stations.push_back(std::make_unique<Station>(kind));
+            }
+        }
+        for (size_t i = 0; i < stations.size(); ++i) {
+            workers.emplace_back(&KitchenScheduler::run, this, i);
+        }
+        if (batchWindow.count() > 0) {
+            batcher = std::thread(&KitchenScheduler::closeBatches, this);
+        }
+        notifier = std::thread(&KitchenScheduler::notifyFinished, this);
+    }
+
+    ~KitchenScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            batchStopping = true;
+        }
+        batchWake.notify_all();
+        if (batcher.joinable()) {
+            batcher.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            notifierStopping = true;  // Only once no worker can finish another item
+        }
+        finishedWake.notify_all();
+        notifier.join();
+    }
+
+    KitchenScheduler(const KitchenScheduler&) = delete;
+    KitchenScheduler& operator=(const KitchenScheduler&) = delete;
+
+    // Hand a line item to the kitchen, joining the open batch of its dish if there is one
+    void submit(PrepTask task) {
+        task.queuedAt = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(batchMutex);
+        auto open = openBatches.find(task.dishID);
+        if (open == openBatches.end()) {
+            CookBatch batch;
+            batch.dishID = task.dishID;
+            batch.kind = task.kind;
+            batch.opened = task.queuedAt;
+            open = openBatches.emplace(task.dishID, std::move(batch)).first;
+            batchWake.notify_all();  // A new deadline for the batcher
+        }
+        open->second.servings += task.servings;
+        open->second.tasks.push_back(task);
+        if (batchWindow.count() == 0 || open->second.servings >= maxBatchServings) {
+            dispatch(std::move(open->second), task.queuedAt);
+            openBatches.erase(open);
+        }
+    }
+
+    // Current counters of every station
+    std::vector<StationStats> stats() {
+        std::vector<StationStats> result;
+        for (auto& station : stations) {
+            std::lock_guard<std::mutex> lock(station->mutex);
+            result.push_back(StationStats{station->kind, station->prepared, station->stolen, station->tasks.size()});
+        }
+        return result;
+    }
+
+    // Current counters of the batching stage
+    BatchStats batchStats() {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        return batching;
+    }
+
+    // Whether line items are held back to be batched
+    bool batchingEnabled() const {
+        return batchWindow.count() > 0;
+    }
+
+private:
+    // A station and its own batch deque
+    struct Station {
+        explicit Station(StationKind k) : kind(k) {}
+
+        StationKind kind;          // Dishes the station can prepare
+        std::mutex mutex;          // Guards the fields below
+        std::deque<CookBatch> tasks;  // Own work, oldest at the front
+        long long prepared = 0;    // Batches cooked by this station
+        long long stolen = 0;      // Batches taken from other stations
+    };
+
+    std::vector<std::unique_ptr<Station>> stations;
+    std::vector<std::thread> workers;     // One worker per station, same order
+    std::chrono::milliseconds prepTime;   // Simulated time to cook one batch
+    std::mutex mutex;                     // Guards queued, finished, stopping and notifierStopping
+    std::condition_variable wake;         // Signalled when batches are queued or on shutdown
+    int queued[3] = {0, 0, 0};            // Batches waiting per station kind
+    std::vector<int> finished;            // Order IDs of finished line items not yet handed on
+    bool stopping = false;                // Set by the destructor
+    FinishedHandler onFinished;           // Called on the notifier thread
+    std::thread notifier;                 // Hands finished line items to onFinished
+    std::condition_variable finishedWake; // Signalled when line items finish or on shutdown
+    bool notifierStopping = false;        // Set by the destructor once the workers are gone
+
+    std::chrono::milliseconds batchWindow;  // Longest a line item is held for its batch
+    int maxBatchServings;                 // A batch is sent as soon as it reaches this many servings
+    std::thread batcher;                  // Sends batches whose window has passed
+    std::mutex batchMutex;                // Guards openBatches, batching and batchStopping
+    std::condition_variable batchWake;    // Signalled when a batch opens or on shutdown
+    std::unordered_map<int, CookBatch> openBatches;  // Dish ID -> batch still collecting line items
+    BatchStats batching;                  // Counters of the batching stage
+    bool batchStopping = false;           // Set by the destructor
+
+    // Record a closed batch and queue it on the station of its kind with the shortest deque.
+    // Called with batchMutex held.
+    void dispatch(CookBatch batch, std::chrono::steady_clock::time_point now) {
+        batching.batches++;
+        batching.items += static_cast<long long>(batch.tasks.size());
+        batching.largest = std::max(batching.largest, batch.tasks.size());
+        for (auto& task : batch.tasks) {
+            double waitMs = std::chrono::duration<double, std::milli>(now - task.queuedAt).count();
+            batching.totalWaitMs += waitMs;
+            batching.longestWaitMs = std::max(batching.longestWaitMs, waitMs);
+        }
+        Station* target = nullptr;
+        size_t shortest = 0;
+        for (auto& station : stations) {
+            if (station->kind != batch.kind) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(station->mutex);
+            if (target == nullptr || station->tasks.size() < shortest) {
+                target = station.get();
+                shortest = station->tasks.size();
+            }
+        }
+        int kind = static_cast<int>(batch.kind);
+        {
+            std::lock_guard<std::mutex> lock(target->mutex);
+            target->tasks.push_back(std::move(batch));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued[kind]++;
+        }
+        wake.notify_all();  // Only workers of the batch's kind can take it
+    }
+
+    // Batcher loop: send every open batch once its window has passed
+    void closeBatches() {
+        std::unique_lock<std::mutex> lock(batchMutex);
+        while (!batchStopping) {
+            auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+            for (auto it = openBatches.begin(); it != openBatches.end();) {
+                auto deadline = it->second.opened + batchWindow;
+                if (deadline <= now) {
+                    dispatch(std::move(it->second), now);
+                    it = openBatches.erase(it);
+                } else {
+                    next = std::min(next, deadline);
+                    ++it;
+                }
+            }
+            if (next == std::chrono::steady_clock::time_point::max()) {
+                batchWake.wait(lock);
+            } else {
+                batchWake.wait_until(lock, next);
+            }
+        }
+    }
+
+    // Take the next batch for a station: its own oldest, else the newest of another station of its
+    // kind, so the owner and a thief work from opposite ends
+    bool take(size_t self, CookBatch& batch, bool& stolen) {
+        Station& own = *stations[self];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                batch = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                stolen = false;
+                return true;
+            }
+        }
+        for (size_t step = 1; step < stations.size(); ++step) {
+            Station& victim = *stations[(self + step) % stations.size()];
+            if (victim.kind != own.kind) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                batch = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                stolen = true;
                 return true;
             }
         }
         return false;
     }
 
-    // Register a new user in the system
-    void registerUser(User user) {
-        if (std::find_if(users.begin(), users.end(), [&](const User& u) { return u.userID == user.userID; }) != users.end()) {
-            std::cout << "User ID already exists. Please try again.\n";
-            return;
+    // Worker loop of one station
+    void run(size_t self) {
+        Station& own = *stations[self];
+        int kind = static_cast<int>(own.kind);
+        for (;;) {
+            CookBatch batch;
+            bool stolen;
+            if (!take(self, batch, stolen)) {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || queued[kind] > 0; });
+                if (stopping) {
+                    return;
+                }
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queued[kind]--;
+            }
+            if (prepTime.count() > 0) {
+                std::this_thread::sleep_for(prepTime);
+            }
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                own.prepared++;
+                own.stolen += stolen;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& task : batch.tasks) {
+                    finished.push_back(task.orderID);
+                }
+            }
+            finishedWake.notify_one();
         }
-        users.push_back(user);
-        std::cout << "User registered successfully.\n";
     }
 
-    // Add a new user to the system
-    void addUser(User user) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
-            std::cout << "Permission denied.\n";
-            return;
+    // Notifier loop: hand finished line items on as they arrive, outside the scheduler's locks
+    void notifyFinished() {
+        std::vector<int> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            finishedWake.wait(lock, [this] { return notifierStopping || !finished.empty(); });
+            if (finished.empty()) {
+                return;
+            }
+            batch.swap(finished);
+            lock.unlock();
+            onFinished(batch);
+            batch.clear();
+            lock.lock();
         }
-        if (std::find_if(users.begin(), users.end(), [&](const User& u) { return u.userID == user.userID        ; }) != users.end()) {
-            std::cout << "User ID already exists. Returning to main menu.\n";
-            return;
+    }
+};
+
+// What a producer does when the order intake ring is full
+enum class Backpressure {
+    Block,                         // Wait until the committer makes room
+    Reject                         // Refuse the order at once
+};
+
+// Parse a backpressure policy name as given on the command line
+inline bool parseBackpressure(const std::string& name, Backpressure& policy) {
+    if (name == "block") {
+        policy = Backpressure::Block;
+    } else if (name == "reject") {
+        policy = Backpressure::Reject;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// An order waiting in the intake ring, and the promise its producer waits on
+struct IntakeRequest {
+    Order order;
+    std::promise<const char*> done;  // Set to nullptr once committed, or to why the order was refused
+};
+
+// Bounded multi-producer, single-consumer ring of order requests. A producer claims a cell with
+// a compare-and-swap on the tail; the cell's sequence number then tells the consumer when the
+// request is written, and the producers when the consumer has emptied the cell again.
+class IntakeRing {
+public:
+    explicit IntakeRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        cells = std::vector<Cell>(size);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
         }
-        users.push_back(user);
     }
 
-    // Add a new material to the system
-    void addMaterial(Material material) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
-            std::cout << "Permission denied.\n";
-            return;
+    // Add a request, moving it into the ring; false, leaving it untouched, if the ring is full
+    bool tryPush(IntakeRequest& request) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == pos) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.request.emplace(std::move(request));
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (sequence < pos) {
+                return false;  // The cell still holds the request from one lap earlier
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
         }
-         if (std::find_if(materials.begin(), materials.end(), [&](const Material& m) { return m.materialID == material.materialID; }) != materials.end()) {
-            std::cout << "Material ID already exists. Returning to main menu.\n";
-            return;
+    }
+
+    // Take the oldest request, if one is ready; consumer only
+    std::optional<IntakeRequest> tryPop() {
+        Cell& cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+            return std::nullopt;
         }
-        materials.push_back(material);
+        std::optional<IntakeRequest> request = std::move(cell.request);
+        cell.request.reset();
+        cell.sequence.store(head + cells.size(), std::memory_order_release);
+        head++;
+        return request;
     }
 
-    // Add a new dish to the system
-    void addDish(Dish dish) {
-        if (loggedInUser == nullptr || (loggedInUser->getRole() != "Admin" && loggedInUser->getRole() != "Chef")) {
-            std::cout << "Permission denied.\n";
-            return;
+    // Check whether the next request is ready; consumer only
+    bool ready() const {
+        return cells[head & mask].sequence.load(std::memory_order_acquire) == head + 1;
+    }
+
+    size_t capacity() const {
+        return cells.size();
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;  // Position the cell is free for, or that position + 1 once filled
+        std::optional<IntakeRequest> request;
+    };
+
+    std::vector<Cell> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> tail{0};  // Next position producers claim
+    alignas(64) size_t head = 0;              // Next position the consumer takes
+};
+
+// Front door for orders: terminals and feeds submit into a bounded ring, and one committer
+// thread drains it in batches, handing each batch to the commit function
+class OrderIntake {
+public:
+    using CommitBatch = std::function<void(std::vector<IntakeRequest>&)>;
+
+    OrderIntake(size_t capacity, Backpressure whenFull, CommitBatch commit)
+        : ring(capacity), whenFull(whenFull), commit(std::move(commit)) {
+        committer = std::thread(&OrderIntake::run, this);
+    }
+
+    // Commit what is already queued, then stop the committer
+    ~OrderIntake() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
         }
-        if (std::find_if(dishes.begin(), dishes.end(), [&](const Dish& d) { return d.dishID == dish.dishID || d.name == dish.name; }) != dishes.end()) {
-            std::cout << "Dish ID or Name already exists. Returning to main menu.\n";
-            return;
+        wake.notify_one();
+        committer.join();
+    }
+
+    // Queue an order; the future gives nullptr once it is committed, or why it was refused
+    std::future<const char*> submit(Order order) {
+        IntakeRequest request{std::move(order), {}};
+        std::future<const char*> result = request.done.get_future();
+        while (!ring.tryPush(request)) {
+            if (whenFull == Backpressure::Reject) {
+                request.done.set_value("Order intake is full.");
+                return result;
+            }
+            blockedProducers++;
+            {
+                // The timeout covers a batch that finished between the failed push and the wait
+                std::unique_lock<std::mutex> lock(mutex);
+                space.wait_for(lock, std::chrono::milliseconds(1));
+            }
+            blockedProducers--;
         }
-        dishes.push_back(dish);
+        // Pairs with the fence in run(): either the committer sees this request, or we see it idle
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wake.notify_one();
+        }
+        return result;
     }
 
-    // Add a new customer to the system
-    void addCustomer(Customer customer) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
-            std::cout << "Permission denied.\n";
-            return;
+private:
+    IntakeRing ring;
+    Backpressure whenFull;
+    CommitBatch commit;
+    std::thread committer;
+    std::mutex mutex;                 // Only for sleeping: the ring itself is lock-free
+    std::condition_variable wake;     // Committer waits here while the ring is empty
+    std::condition_variable space;    // Blocked producers wait here while the ring is full
+    std::atomic<bool> idle{false};    // Committer is (about to be) asleep
+    std::atomic<int> blockedProducers{0};
+    bool stopping = false;            // Guarded by mutex
+
+    void run() {
+        std::vector<IntakeRequest> batch;
+        for (;;) {
+            while (batch.size() < ring.capacity()) {
+                std::optional<IntakeRequest> request = ring.tryPop();
+                if (!request) {
+                    break;
+                }
+                batch.push_back(std::move(*request));
+            }
+            if (!batch.empty()) {
+                commit(batch);
+                batch.clear();
+                if (blockedProducers > 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    space.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            idle = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wake.wait(lock, [this] { return stopping || ring.ready(); });
+            idle = false;
+            if (stopping && !ring.ready()) {
+                return;
+            }
         }
-        if (std::find_if(customers.begin(), customers.end(), [&](const Customer& c) { return c.customerID == customer.customerID; }) != customers.end()) {
-            std::cout << "Customer ID already exists. Returning to main menu.\n";
-            return;
+    }
+};
+
+// Hands out commit epochs to writers and tracks the epochs readers have pinned, without a lock.
+// A commit links its versions into their chains as pending, then stamps all of them with one
+// epoch taken from an atomic counter. A reader pinned at epoch E waits out the pending versions
+// it meets, so it sees every commit stamped up to E and none of the later ones.
+class EpochClock {
+public:
+    static constexpr uint64_t PENDING = UINT64_MAX;  // Epoch of a version not yet committed
+
+    // Scope of one commit. Versions published on this thread while it is open join it, also
+    // from nested scopes, and all of them become visible together when the outermost one ends.
+    // Writers end it before releasing the locks of the records it wrote.
+    class Commit {
+        EpochClock& clock;
+        Commit* const outer;           // Open commit this scope joined, if any
+        std::vector<std::atomic<uint64_t>*> published;  // Epochs to stamp at the end
+        std::vector<const std::atomic<uint64_t>*> after;  // Pending versions of other commits it built on
+        uint64_t oldest = PENDING;     // Horizon, read once per commit
+    public:
+        explicit Commit(EpochClock& clock) : clock(clock), outer(open) {
+            if (outer == nullptr) {
+                open = this;
+            }
+        }
+        ~Commit() {
+            if (outer == nullptr) {
+                open = nullptr;
+                clock.stamp(*this);
+            }
+        }
+        Commit(const Commit&) = delete;
+        Commit& operator=(const Commit&) = delete;
+
+        // The commit versions published now belong to
+        Commit& owner() {
+            return outer != nullptr ? *outer : *this;
+        }
+
+        // Record a version this commit published, and the pending one it was linked over
+        void record(std::atomic<uint64_t>& epoch, const std::atomic<uint64_t>* below) {
+            published.push_back(&epoch);
+            if (below != nullptr) {
+                after.push_back(below);
+            }
+        }
+
+        // Oldest epoch a reader can still ask for; versions behind it can be freed
+        uint64_t horizon() {
+            if (oldest == PENDING) {
+                oldest = clock.horizon();
+            }
+            return oldest;
+        }
+
+    private:
+        friend class EpochClock;
+        static inline thread_local Commit* open = nullptr;
+    };
+
+    // The latest epoch, pinned for one reader until it goes out of scope
+    class Pin {
+        std::atomic<uint64_t>& slot;
+    public:
+        const uint64_t epoch;          // Epoch the reader sees
+
+        // The slot announces an epoch read before the pinned one, so a writer either sees the
+        // announcement or computed its horizon early enough not to reach the pinned epoch
+        explicit Pin(EpochClock& clock) : slot(clock.claim()), epoch(clock.current.load()) {}
+        ~Pin() {
+            slot.store(FREE);
+        }
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+    };
+
+    EpochClock() = default;
+    EpochClock(const EpochClock&) = delete;
+    EpochClock& operator=(const EpochClock&) = delete;
+
+    ~EpochClock() {
+        for (Reader* reader = readers.load(); reader != nullptr;) {
+            Reader* next = reader->next;
+            delete reader;
+            reader = next;
+        }
+    }
+
+private:
+    static constexpr uint64_t FREE = UINT64_MAX;  // Reader slot not in use
+
+    // Slot a reader announces its epoch in; slots are reused, and freed with the clock
+    struct Reader {
+        std::atomic<uint64_t> epoch;
+        Reader* next;
+    };
+
+    std::atomic<uint64_t> current{0};  // Epoch of the latest commit
+    std::atomic<Reader*> readers{nullptr};
+
+    std::atomic<uint64_t>& claim() {
+        uint64_t announced = current.load();
+        for (Reader* reader = readers.load(); reader != nullptr; reader = reader->next) {
+            uint64_t expected = FREE;
+            if (reader->epoch.load(std::memory_order_relaxed) == FREE &&
+                reader->epoch.compare_exchange_strong(expected, announced)) {
+                return reader->epoch;
+            }
+        }
+        Reader* reader = new Reader{announced, readers.load()};
+        while (!readers.compare_exchange_weak(reader->next, reader)) {
+        }
+        return reader->epoch;
+    }
+
+    uint64_t horizon() const {
+        uint64_t oldest = current.load();
+        for (Reader* reader = readers.load(); reader != nullptr; reader = reader->next) {
+            oldest = std::min(oldest, reader->epoch.load());
+        }
+        return oldest;
+    }
+
+    // Commits stamp after the ones they built on, so a chain never holds a stamped version
+    // above a pending one
+    void stamp(Commit& commit) {
+        for (const std::atomic<uint64_t>* below : commit.after) {
+            while (below->load(std::memory_order_acquire) == PENDING) {
+                std::this_thread::yield();
+            }
+        }
+        if (commit.published.empty()) {
+            return;
+        }
+        uint64_t epoch = current.fetch_add(1) + 1;
+        for (std::atomic<uint64_t>* published : commit.published) {
+            published->store(epoch, std::memory_order_release);
+        }
+    }
+};
+
+// Multi-version copy of a store, read without locks at a pinned epoch. Each record keeps a
+// chain of versions, newest first. Writers, holding the lock of the store the copy mirrors,
+// push a version on every change and free the versions no pinned reader can reach any more.
+template <typename T>
+class VersionedStore {
+private:
+    struct Version;
+
+public:
+    // A version allocated ahead of time, so that a writer under a busy lock only links it
+    class Staged {
+    public:
+        explicit operator bool() const {
+            return version != nullptr;
+        }
+
+        T& value() {
+            return *version->value;
+        }
+
+    private:
+        friend class VersionedStore;
+        std::unique_ptr<Version> version;
+    };
+
+    VersionedStore() = default;
+    VersionedStore(const VersionedStore&) = delete;
+    VersionedStore& operator=(const VersionedStore&) = delete;
+
+    ~VersionedStore() {
+        clear();
+    }
+
+    // Free every version. Only while no reader is pinned and no writer is publishing.
+    void clear() {
+        for (size_t chunk = 0; chunk < MAX_CHUNKS; ++chunk) {
+            std::atomic<Version*>* heads = chunks[chunk].load();
+            if (heads == nullptr) {
+                break;
+            }
+            for (size_t offset = 0; offset < chunkSize(chunk); ++offset) {
+                freeChain(heads[offset].load());
+            }
+            delete[] heads;
+            chunks[chunk].store(nullptr);
+        }
+        used.store(0);
+        slots.clear();
+        freeSlots.clear();
+    }
+
+    // Publish the new state of a record
+    void put(EpochClock::Commit& commit, int id, const T& value) {
+        auto found = slots.find(id);
+        push(commit, found != slots.end() ? found->second : claimSlot(id), &value);
+    }
+
+    // Allocate a version to publish later with the put below
+    Staged stage(T value) const {
+        Staged staged;
+        staged.version.reset(new Version{std::move(value), EpochClock::PENDING, nullptr, nullptr});
+        return staged;
+    }
+
+    // Publish a staged version. If the commit already has a pending version of the record, that
+    // one takes the value and the staged one, holding the earlier value, is left for the caller
+    // to free.
+    void put(EpochClock::Commit& commit, int id, Staged& staged) {
+        auto found = slots.find(id);
+        size_t slot = found != slots.end() ? found->second : claimSlot(id);
+        if (Version* own = ownPending(commit, slot)) {
+            own->value.swap(staged.version->value);
+        } else {
+            link(commit, slot, staged.version.release());
+        }
+    }
+
+    // Publish the removal of a record; its slot goes to the next record added
+    void erase(EpochClock::Commit& commit, int id) {
+        auto found = slots.find(id);
+        if (found != slots.end()) {
+            push(commit, found->second, nullptr);
+            freeSlots.push_back(found->second);
+            slots.erase(found);
+        }
+    }
+
+    // Publish a whole new set of records, removing the ones it no longer holds (snapshot load)
+    template <typename GetID>
+    void replaceAll(EpochClock::Commit& commit, const std::vector<T>& records, GetID getID) {
+        std::unordered_map<int, size_t> kept;
+        for (size_t i = 0; i < records.size(); ++i) {
+            kept[getID(records[i])] = i;
+        }
+        std::vector<int> removed;
+        for (auto& slot : slots) {
+            if (!kept.count(slot.first)) {
+                removed.push_back(slot.first);
+            }
+        }
+        for (int id : removed) {
+            erase(commit, id);
+        }
+        for (auto& record : records) {
+            put(commit, getID(record), record);
+        }
+    }
+
+    // Visit every record as it was at a pinned epoch, in slot order
+    template <typename Visit>
+    void forEach(uint64_t epoch, Visit visit) const {
+        scan(epoch, [&](const T& record) {
+            visit(record);
+            return true;
+        });
+    }
+
+    // Check whether any record existed at a pinned epoch
+    bool any(uint64_t epoch) const {
+        bool found = false;
+        scan(epoch, [&](const T&) {
+            found = true;
+            return false;
+        });
+        return found;
+    }
+
+private:
+    struct Version {
+        std::optional<T> value;        // State of the record, empty once it was removed
+        std::atomic<uint64_t> epoch;   // Commit that published this version, PENDING until stamped
+        Version* older;                // Previous version, cut off once no reader can reach it
+        const EpochClock::Commit* writer;  // Commit that linked it, to merge repeated writes
+    };
+
+    // Record heads live in chunks that never move, so readers can walk them while writers add
+    // records. Each chunk doubles the last, so the directory never runs out.
+    static constexpr size_t FIRST_CHUNK = 256;
+    static constexpr size_t MAX_CHUNKS = 48;
+
+    std::array<std::atomic<std::atomic<Version*>*>, MAX_CHUNKS> chunks{};
+    std::atomic<size_t> used{0};       // Slots handed out so far
+    std::unordered_map<int, size_t> slots;  // Record ID -> slot, used by writers only
+    std::vector<size_t> freeSlots;     // Slots of removed records, used by writers only
+
+    static size_t chunkSize(size_t chunk) {
+        return FIRST_CHUNK << chunk;
+    }
+
+    std::atomic<Version*>& head(size_t slot) const {
+        size_t chunk = 0;
+        size_t offset = slot;
+        while (offset >= chunkSize(chunk)) {
+            offset -= chunkSize(chunk);
+            ++chunk;
+        }
+        return chunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+
+    // Slot for a new record: a freed one, whose old versions stay below the new record's, or
+    // the next one, allocating its chunk first so nothing can fail once the chain changes
+    size_t claimSlot(int id) {
+        size_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = used.load(std::memory_order_relaxed);
+            size_t chunk = 0;
+            size_t offset = slot;
+            while (offset >= chunkSize(chunk)) {
+                offset -= chunkSize(chunk);
+                ++chunk;
+            }
+            if (offset == 0) {
+                chunks[chunk].store(new std::atomic<Version*>[chunkSize(chunk)](), std::memory_order_release);
+            }
+            used.store(slot + 1, std::memory_order_release);
+        }
+        slots[id] = slot;
+        return slot;
+    }
+
+    // Walk the slots at an epoch until the visitor returns false
+    template <typename Visit>
+    void scan(uint64_t epoch, Visit visit) const {
+        size_t count = used.load(std::memory_order_acquire);
+        for (size_t chunk = 0, first = 0; first < count; first += chunkSize(chunk), ++chunk) {
+            const std::atomic<Version*>* heads = chunks[chunk].load(std::memory_order_acquire);
+            size_t last = std::min(count - first, chunkSize(chunk));
+            for (size_t offset = 0; offset < last; ++offset) {
+                const T* record = at(heads[offset], epoch);
+                if (record != nullptr && !visit(*record)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // State of the record in a slot at an epoch, nullptr if it did not exist then
+    static const T* at(const std::atomic<Version*>& slotHead, uint64_t epoch) {
+        const Version* version = slotHead.load(std::memory_order_acquire);
+        while (version != nullptr) {
+            uint64_t stamped = version->epoch.load(std::memory_order_acquire);
+            while (stamped == EpochClock::PENDING) {
+                std::this_thread::yield();
+                stamped = version->epoch.load(std::memory_order_acquire);
+            }
+            if (stamped <= epoch) {
+                break;
+            }
+            version = version->older;
+        }
+        return version != nullptr && version->value ? &*version->value : nullptr;
+    }
+
+    static void freeChain(Version* version) {
+        while (version != nullptr) {
+            Version* older = version->older;
+            delete version;
+            version = older;
+        }
+    }
+
+    // Publish the state of a slot, or its removal when value is null
+    void push(EpochClock::Commit& commit, size_t slot, const T* value) {
+        if (Version* own = ownPending(commit, slot)) {
+            if (value != nullptr) {
+                own->value = *value;
+            } else {
+                own->value.reset();
+            }
+            return;
+        }
+        std::optional<T> state;
+        if (value != nullptr) {
+            state = *value;
+        }
+        link(commit, slot, new Version{std::move(state), EpochClock::PENDING, nullptr, nullptr});
+    }
+
+    // The newest version of a slot if the commit linked it and has not stamped it yet. Readers
+    // wait for the stamp before looking at the value, so that version can simply take the
+    // later state.
+    Version* ownPending(EpochClock::Commit& scope, size_t slot) const {
+        Version* newest = head(slot).load(std::memory_order_relaxed);
+        if (newest == nullptr || newest->epoch.load(std::memory_order_acquire) != EpochClock::PENDING
+            || newest->writer != &scope.owner()) {
+            return nullptr;
+        }
+        return newest;
+    }
+
+    // Make a version the newest of its slot
+    void link(EpochClock::Commit& scope, size_t slot, Version* version) {
+        EpochClock::Commit& commit = scope.owner();
+        std::atomic<Version*>& slotHead = head(slot);
+        Version* newest = slotHead.load(std::memory_order_relaxed);
+        bool pending = newest != nullptr && newest->epoch.load(std::memory_order_acquire) == EpochClock::PENDING;
+        version->older = newest;
+        version->writer = &commit;
+        commit.record(version->epoch, pending ? &newest->epoch : nullptr);
+        slotHead.store(version, std::memory_order_release);
+        // Every reader stops at or before the newest stamped version within the horizon, so the
+        // ones behind it can go
+        uint64_t horizon = commit.horizon();
+        Version* kept = version->older;
+        while (kept != nullptr) {
+            uint64_t stamped = kept->epoch.load(std::memory_order_acquire);
+            if (stamped != EpochClock::PENDING && stamped <= horizon) {
+                break;
+            }
+            kept = kept->older;
+        }
+        if (kept != nullptr) {
+            Version* unreachable = kept->older;
+            kept->older = nullptr;
+            freeChain(unreachable);
+        }
+    }
+};
+
+// Position of an open order in the kitchen queue: orders not yet started come first, then the
+// highest priority, then the oldest
+struct KitchenTicket {
+    bool started;                  // Order is already in preparation
+    int priority;                  // Kitchen priority of the order
+    long long sequence;            // Placement order of the order
+    int orderID;                   // Order ID, breaks ties between orders loaded without a sequence
+
+    bool operator<(const KitchenTicket& other) const {
+        return std::tie(started, other.priority, sequence, orderID)
+             < std::tie(other.started, priority, other.sequence, other.orderID);
+    }
+};
+
+// Class representing the restaurant management system
+class RestaurantManagementSystem {
+private:
+    using ReadLock = std::shared_lock<std::shared_mutex>;
+    using WriteLock = std::unique_lock<std::shared_mutex>;
+
+    // A logged-in user; holds the user's ID rather than a pointer so it survives store reallocation
+    struct Session {
+        int userID;                       // User the session belongs to
+        unsigned permissions;             // Permissions of the user's role, computed at login
+    };
+
+    // One shard of the orders table; an order lives in the shard of its ID modulo ORDER_SHARDS
+    struct OrderShard {
+        mutable std::shared_mutex lock;   // Guards the two fields below
+        std::vector<Order> orders;        // Orders of this shard
+        std::unordered_map<int, size_t> index;  // Order ID -> slot in orders
+        VersionedStore<Order> versions;   // Point-in-time copies of the orders for reports
+    };
+    static constexpr size_t ORDER_SHARDS = 16;
+    static constexpr int IMPORT_CHUNK_ROWS = 1000;  // CSV rows imported per journal record and lock hold
+
+    std::vector<User> users;              // List of users in the system
+    std::vector<Material> materials;      // List of materials in the system
+    std::vector<Dish> dishes;             // List of dishes in the system
+    std::vector<Customer> customers;      // List of customers in the system
+    std::array<OrderShard, ORDER_SHARDS> orderShards;  // Orders in the system, sharded by ID
+    std::vector<Notification> notifications; // List of notifications in the system
+    Finance finance;                      // Running financial totals, updated on every mutation
+    bool verifyFinance = false;           // Cross-check the running totals against a full recompute
+
+    // Each store is guarded by its own reader-writer lock. Locks are always taken in this order:
+    // versionsStartLock, users, dishes, materials, customers, order shards (lowest first), stockLock, notifications,
+    // then at most one of orderTrackingLock, financeLock and sessionLock, which are held only
+    // briefly.
+    mutable std::shared_mutex userLock;          // users and their indexes
+    mutable std::shared_mutex dishLock;          // dishes and their indexes, cached ingredient costs
+    mutable std::shared_mutex materialLock;      // materials and their indexes, the servings table
+    std::mutex stockLock;                 // Material quantities, stockLevelIndex and the servings table while
+                                          // orders reserve stock under a shared materialLock
+    mutable std::shared_mutex customerLock;      // customers and their index
+    mutable std::shared_mutex notificationLock;  // notifications, their index and nextNotificationID
+    std::mutex orderTrackingLock;         // ordersByCustomer, the kitchen queue, prepTasksLeft, nextOrderSequence
+    std::mutex financeLock;               // finance
+    mutable std::shared_mutex sessionLock;       // sessions
+
+    // ID -> slot indexes kept in step with the vectors above
+    std::unordered_map<int, size_t> userIndex;
+    std::unordered_map<std::string, int> usernameIndex;  // Username -> user ID
+    std::unordered_map<int, size_t> materialIndex;
+    std::set<std::pair<long long, int>> stockLevelIndex;  // (quantity - warningThreshold, material ID), most critical first
+    std::vector<std::unique_ptr<StockCounter>> stockCounters;  // Live stock of each material (by slot)
+    std::unordered_map<int, size_t> dishIndex;
+    std::unordered_map<std::string, int> dishNameIndex;   // Dish name -> dish ID
+    std::unordered_map<int, std::vector<int>> dishesByMaterial;  // Material ID -> IDs of dishes using it
+    std::unordered_map<int, size_t> customerIndex;
+    std::unordered_map<int, CustomerOrders> ordersByCustomer;  // Customer ID -> unpaid orders
+    std::unordered_map<int, size_t> unpaidSlots;  // Unpaid order ID -> position in its customer's unpaidIDs
+    std::set<KitchenTicket> kitchenQueue; // Orders not yet completed, next to prepare first
+    std::unordered_map<int, std::set<KitchenTicket>::iterator> kitchenTickets;  // Order ID -> its ticket
+    long long nextOrderSequence = 1;      // Sequence given to the next order placed
+    std::unique_ptr<KitchenScheduler> kitchen;  // Station workers, running once startKitchen is called
+    std::unique_ptr<OrderIntake> intake;  // Order intake ring and its committer, running once startIntake is called
+    std::unordered_map<int, int> prepTasksLeft; // Order ID -> prep tasks of the order still at a station
+    std::unordered_map<int, size_t> notificationIndex;
+    ServingsTable servings;               // Servings of each dish (by slot) the stock supports
+    bool servingsDeferred = false;        // Hold table rebuilds during a bulk import (materialLock exclusive)
+    std::shared_ptr<const AvailableMenu> availableMenu = std::make_shared<const AvailableMenu>();  // Current menu view, read and swapped atomically
+    int nextNotificationID = 1;           // ID given to the next system-generated notification
+
+    Journal journal;                      // Write-ahead journal of every mutation since the last snapshot
+
+    // Reports read orders, materials and dishes from pinned versions instead of taking the store
+    // locks. Versions are published with the journal records, under the store's write lock (or
+    // stockLock, for quantities reserved by orders), while reports run: the first report builds
+    // the chains and the last one to finish frees them.
+    EpochClock versionClock;
+    VersionedStore<Material> materialVersions;
+    VersionedStore<Dish> dishVersions;
+    std::atomic<bool> versionsLive{false};  // Chains built; flipped under read locks of every versioned store
+    std::atomic<int> versionReaders{0};   // Reports holding a ReportView
+    std::mutex versionsStartLock;         // Held while chains are built or freed, before any store lock
+
+    std::unordered_map<SessionToken, Session> sessions;  // Open sessions by token
+
+    // Check whether the user of a session holds a permission; unknown tokens hold none
+    bool allowed(SessionToken session, unsigned permission) const {
+        ReadLock read(sessionLock);
+        auto found = sessions.find(session);
+        return found != sessions.end() && (found->second.permissions & permission) != 0;
+    }
+
+    // Refresh the permissions of every session of a user, after a role change or removal
+    void refreshSessionsOf(int userID, unsigned permissions) {
+        WriteLock write(sessionLock);
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            if (it->second.userID != userID) {
+                ++it;
+            } else if (permissions == 0) {
+                it = sessions.erase(it);
+            } else {
+                it->second.permissions = permissions;
+                ++it;
+            }
+        }
+    }
+
+    // Shard an order ID belongs to
+    OrderShard& shardFor(int orderID) {
+        return orderShards[shardOf(orderID)];
+    }
+
+    static size_t shardOf(int orderID) {
+        return static_cast<unsigned>(orderID) % ORDER_SHARDS;
+    }
+
+    // Find an order in its shard, whose lock the caller holds; nullptr if absent
+    Order* findOrder(OrderShard& shard, int orderID) {
+        auto found = shard.index.find(orderID);
+        return found == shard.index.end() ? nullptr : &shard.orders[found->second];
+    }
+
+    // Whether an order may still have its lines changed: once the kitchen has started on it,
+    // its stock is in use and its prep tasks are out; once paid, its fee is settled
+    static bool isModifiable(const Order& order) {
+        return order.status == OrderStatus::New && !order.paid;
+    }
+
+    // Check under a shared lock whether a store holds an ID
+    static bool contains(std::shared_mutex& lock, const std::unordered_map<int, size_t>& index, int id) {
+        ReadLock read(lock);
+        return index.count(id) != 0;
+    }
+
+    // Take every store lock in the documented order, for whole-system operations
+    template <typename Lock>
+    std::vector<Lock> lockAllStores() const {
+        std::vector<Lock> locks;
+        locks.emplace_back(userLock);
+        locks.emplace_back(dishLock);
+        locks.emplace_back(materialLock);
+        locks.emplace_back(customerLock);
+        for (auto& shard : orderShards) {
+            locks.emplace_back(shard.lock);
+        }
+        locks.emplace_back(notificationLock);
+        return locks;
+    }
+
+    // Sum of the fees of every order; the caller holds every shard lock
+    Money totalOrderFees() const {
+        Money total;
+        for (auto& shard : orderShards) {
+            for (auto& order : shard.orders) {
+                total += order.totalFee;
+            }
+        }
+        return total;
+    }
+
+    // Apply the change of an order's fee to the running totals
+    void applyOrderDelta(Money oldFee, Money newFee) {
+        std::lock_guard<std::mutex> lock(financeLock);
+        finance.applyOrderDelta(oldFee, newFee);
+    }
+
+    // Apply the change of a material's stock value to the running totals
+    void applyMaterialDelta(Money oldValue, Money newValue) {
+        std::lock_guard<std::mutex> lock(financeLock);
+        finance.applyMaterialDelta(oldValue, newValue);
+    }
+
+    // Copy of a material with its live stock read from the counter, so a reader holding
+    // materialLock shared need not take stockLock; the mirrored quantity, revision and warning
+    // flag are written under stockLock and are not read here
+    Material stockedMaterial(size_t slot) const {
+        const Material& material = materials[slot];
+        return Material(material.materialID, material.name, material.price,
+                        stockCounters[slot]->quantity.load(std::memory_order_relaxed), material.warningThreshold);
+    }
+
+    // Key of a material in stockLevelIndex
+    static std::pair<long long, int> stockLevelKey(const Material& material) {
+        return {static_cast<long long>(material.quantity) - material.warningThreshold, material.materialID};
+    }
+
+    // Remove the element at the given slot by moving the last element into its place
+    template <typename T, typename GetID>
+    static void eraseSlot(std::vector<T>& store, std::unordered_map<int, size_t>& index, size_t slot, GetID getID) {
+        index.erase(getID(store[slot]));
+        if (slot + 1 != store.size()) {
+            store[slot] = std::move(store.back());
+            index[getID(store[slot])] = slot;
+        }
+        store.pop_back();
+    }
+
+    // Lay the servings table out again after dishes were added, changed or moved between slots.
+    // Called with dishLock held and materialLock held exclusively, as are the two below.
+    void refreshServings() {
+        if (!servingsDeferred) {
+            servings.build(dishes, materials, materialIndex);
+            publishMenu();
+        }
+    }
+
+    // Pass a material's new stock level to the servings table, republishing the menu only if a
+    // dish using it went in or out of stock
+    void refreshServings(const Material& material) {
+        if (servings.setStock(material.materialID, material.quantity) && !servingsDeferred) {
+            publishMenu();
+        }
+    }
+
+    // Build a new menu view from the servings table and swap it in
+    void publishMenu() {
+        auto menu = std::make_shared<AvailableMenu>();
+        for (size_t i = 0; i < dishes.size(); ++i) {
+            if (servings.available(i) > 0) {
+                menu->dishIndex[dishes[i].dishID] = menu->dishes.size();
+                menu->dishes.push_back(dishes[i]);
+            }
+        }
+        std::atomic_store(&availableMenu, std::shared_ptr<const AvailableMenu>(std::move(menu)));
+    }
+
+    // Cost of one serving of the given ingredients, with one material optionally priced at
+    // changedPrice instead of its stored price. Returns false if it is beyond Money::MAX_CENTS.
+    bool ingredientCost(const std::vector<Ingredient>& ingredients, Money& cost,
+                        int changedID = 0, const Money* changedPrice = nullptr) const {
+        cost = Money();
+        for (auto& ingredient : ingredients) {
+            auto material = materialIndex.find(ingredient.materialID);
+            if (material == materialIndex.end()) {
+                continue;
+            }
+            Money price = changedPrice != nullptr && ingredient.materialID == changedID
+                        ? *changedPrice : materials[material->second].price;
+            if (!cost.addWithinLimit(price, ingredient.amount)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Recompute the cached ingredient cost of one dish; callers have checked that it is in range
+    void refreshDishCost(Dish& dish) {
+        ingredientCost(dish.ingredients, dish.ingredientCost);
+    }
+
+    // Whether every dish using a material keeps its ingredient cost in range at a new price
+    bool dishCostsFit(int materialID, Money price) const {
+        auto usage = dishesByMaterial.find(materialID);
+        if (usage == dishesByMaterial.end()) {
+            return true;
+        }
+        Money cost;
+        for (int dishID : usage->second) {
+            if (!ingredientCost(dishes[dishIndex.at(dishID)].ingredients, cost, materialID, &price)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Recompute the ingredient cost of only the dishes that use a material
+    void refreshDishCostsUsing(int materialID) {
+        auto usage = dishesByMaterial.find(materialID);
+        if (usage == dishesByMaterial.end()) {
+            return;
+        }
+        for (int dishID : usage->second) {
+            Dish& dish = dishes[dishIndex.at(dishID)];
+            refreshDishCost(dish);
+            publishVersion(dish);  // Cost is derived, so it is not journaled
+        }
+    }
+
+    // Record a dish under each material it uses
+    void linkDish(const Dish& dish) {
+        for (size_t i = 0; i < dish.ingredients.size(); ++i) {
+            int materialID = dish.ingredients[i].materialID;
+            auto repeat = std::find_if(dish.ingredients.begin(), dish.ingredients.begin() + i,
+                                       [&](const Ingredient& earlier) { return earlier.materialID == materialID; });
+            if (repeat == dish.ingredients.begin() + i) {
+                dishesByMaterial[materialID].push_back(dish.dishID);
+            }
+        }
+    }
+
+    // Remove a dish from the entries of the materials it uses
+    void unlinkDish(const Dish& dish) {
+        for (auto& ingredient : dish.ingredients) {
+            auto entry = dishesByMaterial.find(ingredient.materialID);
+            if (entry == dishesByMaterial.end()) {
+                continue;  // Already removed for an earlier repeat of this material
+            }
+            std::vector<int>& ids = entry->second;
+            auto pos = std::find(ids.begin(), ids.end(), dish.dishID);
+            if (pos != ids.end()) {
+                *pos = ids.back();
+                ids.pop_back();
+            }
+            if (ids.empty()) {
+                dishesByMaterial.erase(entry);
+            }
+        }
+    }
+
+    // Record an order under its customer and, until it is completed, in the kitchen queue.
+    // Called with orderTrackingLock held, as is unlinkOrder.
+    void linkOrder(const Order& order) {
+        linkToCustomer(order);
+        if (order.status != OrderStatus::Completed) {
+            kitchenTickets[order.orderID] = kitchenQueue.insert(ticketFor(order)).first;
+        }
+    }
+
+    // Record an unpaid order under its customer
+    void linkToCustomer(const Order& order) {
+        if (order.paid) {
+            return;
+        }
+        CustomerOrders& entry = ordersByCustomer[order.customerID];
+        unpaidSlots[order.orderID] = entry.unpaidIDs.size();
+        entry.unpaidIDs.push_back(order.orderID);
+        entry.unpaidTotal += order.totalFee;
+    }
+
+    static KitchenTicket ticketFor(const Order& order) {
+        return KitchenTicket{order.status == OrderStatus::InPreparation, order.priority, order.sequence, order.orderID};
+    }
+
+    // Remove an order from its customer's entry and from the kitchen queue
+    void unlinkOrder(const Order& order) {
+        auto ticket = kitchenTickets.find(order.orderID);
+        if (ticket != kitchenTickets.end()) {
+            kitchenQueue.erase(ticket->second);
+            kitchenTickets.erase(ticket);
+        }
+        auto slot = unpaidSlots.find(order.orderID);
+        if (slot == unpaidSlots.end()) {
+            return;
+        }
+        auto entry = ordersByCustomer.find(order.customerID);
+        std::vector<int>& ids = entry->second.unpaidIDs;
+        ids[slot->second] = ids.back();
+        unpaidSlots[ids.back()] = slot->second;
+        ids.pop_back();
+        unpaidSlots.erase(order.orderID);
+        entry->second.unpaidTotal -= order.totalFee;
+        if (ids.empty()) {
+            ordersByCustomer.erase(entry);
+        }
+    }
+
+    // Apply a validated status change, moving the order within (or out of) the kitchen queue.
+    // An order going into preparation is split into prep tasks for the stations. Called with
+    // the order's shard locked exclusively, and with dishLock held when starting preparation.
+    void changeOrderStatus(Order& order, OrderStatus status) {
+        {
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            unlinkOrder(order);
+            order.updateStatus(status);
+            linkOrder(order);
+            if (status == OrderStatus::InPreparation) {
+                dispatchOrder(order);
+            } else if (status == OrderStatus::Completed) {
+                prepTasksLeft.erase(order.orderID);
+            }
+        }
+        journalPut(JournalOp::PutOrder, order);
+    }
+
+    // Send one prep task per order line to the station for the dish's category.
+    // Called with dishLock and orderTrackingLock held.
+    void dispatchOrder(const Order& order) {
+        if (!kitchen || order.lines.empty()) {
+            return;
+        }
+        prepTasksLeft[order.orderID] = static_cast<int>(order.lines.size());
+        for (auto& line : order.lines) {
+            auto dish = dishIndex.find(line.dishID);
+            StationKind kind = dish == dishIndex.end() ? StationKind::Grill : stationFor(dishes[dish->second].category);
+            kitchen->submit(PrepTask{order.orderID, line.dishID, line.quantity, kind, {}});
+        }
+    }
+
+    // Complete the orders whose last prep task is among the finished ones; called on the
+    // kitchen's notifier thread
+    void finishTasks(const std::vector<int>& finished) {
+        JournalSync sync(journal);
+        std::vector<int> done;
+        {
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            for (int orderID : finished) {
+                auto left = prepTasksLeft.find(orderID);
+                if (left == prepTasksLeft.end() || --left->second > 0) {
+                    continue;  // Order was completed by hand or deleted, or still has tasks running
+                }
+                prepTasksLeft.erase(left);
+                done.push_back(orderID);
+            }
+        }
+        for (int orderID : done) {
+            OrderShard& shard = shardFor(orderID);
+            WriteLock write(shard.lock);
+            Order* order = findOrder(shard, orderID);
+            if (order != nullptr && order->status == OrderStatus::InPreparation) {
+                changeOrderStatus(*order, OrderStatus::Completed);
+            }
+        }
+    }
+
+    // Rebuild every index and the finance totals from the stores; the caller holds every store lock
+    void rebuildIndexes() {
+        userIndex.clear();
+        usernameIndex.clear();
+        for (size_t i = 0; i < users.size(); ++i) {
+            userIndex[users[i].userID] = i;
+            usernameIndex[users[i].username] = users[i].userID;
+        }
+        materialIndex.clear();
+        stockLevelIndex.clear();
+        stockCounters.clear();
+        for (size_t i = 0; i < materials.size(); ++i) {
+            materialIndex[materials[i].materialID] = i;
+            stockLevelIndex.insert(stockLevelKey(materials[i]));
+            stockCounters.push_back(std::make_unique<StockCounter>(materials[i].quantity));
+        }
+        dishIndex.clear();
+        dishNameIndex.clear();
+        dishesByMaterial.clear();
+        for (size_t i = 0; i < dishes.size(); ++i) {
+            dishIndex[dishes[i].dishID] = i;
+            dishNameIndex[dishes[i].name] = dishes[i].dishID;
+            linkDish(dishes[i]);
+            refreshDishCost(dishes[i]);
+        }
+        customerIndex.clear();
+        for (size_t i = 0; i < customers.size(); ++i) {
+            customerIndex[customers[i].customerID] = i;
+        }
+        {
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            ordersByCustomer.clear();
+            unpaidSlots.clear();
+            kitchenQueue.clear();
+            kitchenTickets.clear();
+            nextOrderSequence = 1;
+            std::vector<KitchenTicket> tickets;
+            std::vector<size_t> runs{0};  // Where each shard's tickets start, then the end
+            for (auto& shard : orderShards) {
+                shard.index.clear();
+                shard.index.reserve(shard.orders.size());
+                for (size_t i = 0; i < shard.orders.size(); ++i) {
+                    const Order& order = shard.orders[i];
+                    shard.index[order.orderID] = i;
+                    linkToCustomer(order);
+                    if (order.status != OrderStatus::Completed) {
+                        tickets.push_back(ticketFor(order));
+                    }
+                    nextOrderSequence = std::max(nextOrderSequence, order.sequence + 1);
+                }
+                auto run = tickets.begin() + runs.back();
+                if (!std::is_sorted(run, tickets.end())) {
+                    std::sort(run, tickets.end());
+                }
+                runs.push_back(tickets.size());
+            }
+            // Queue the open orders in sorted order, so each ticket goes in at the end. A shard
+            // keeps its orders about as they were placed, so its run is usually sorted already;
+            // the runs are then merged pairwise.
+            while (runs.size() > 2) {
+                std::vector<size_t> merged{0};
+                for (size_t i = 2; i < runs.size(); i += 2) {
+                    std::inplace_merge(tickets.begin() + runs[i - 2], tickets.begin() + runs[i - 1], tickets.begin() + runs[i]);
+                    merged.push_back(runs[i]);
+                }
+                if (runs.size() % 2 == 0) {
+                    merged.push_back(runs.back());  // Odd run out, merged next round
+                }
+                runs.swap(merged);
+            }
+            kitchenTickets.reserve(tickets.size());
+            for (auto& ticket : tickets) {
+                kitchenTickets[ticket.orderID] = kitchenQueue.emplace_hint(kitchenQueue.end(), ticket);
+            }
+        }
+        notificationIndex.clear();
+        nextNotificationID = 1;
+        for (size_t i = 0; i < notifications.size(); ++i) {
+            notificationIndex[notifications[i].notificationID] = i;
+            nextNotificationID = std::max(nextNotificationID, notifications[i].notificationID + 1);
+        }
+        refreshServings();
+        if (versionsLive.load()) {
+            publishAllVersions();
+        }
+        std::lock_guard<std::mutex> lock(financeLock);
+        finance.calculateFinance(totalOrderFees(), materials);
+    }
+
+    // Net quantity of one material taken out of stock by an order change
+    struct StockChange {
+        size_t slot;               // Slot of the material in materials
+        int amount;                // Units taken (negative when returned)
+    };
+
+    // New state of a material an order changed. The fields that only change under an exclusive
+    // materialLock are copied before stockLock is taken, the stock fields under it; the rest of
+    // the work for the change is done once stockLock is let go.
+    struct StockRecord {
+        Material material;             // State to journal
+        VersionedStore<Material>::Staged version;  // Version to link under stockLock, if reports are live
+        Money oldValue;                // Stock value (price * quantity) before the change
+        Money newValue;                // And after it
+        bool warn = false;             // Stock just fell to the warning threshold
+        bool menuChanged = false;      // A dish went in or out of stock
+    };
+
+    // Take the ingredients of newLines out of stock and return those of oldLines (e.g. when an
+    // order is modified). Either every material is updated or, if any would run short, none is.
+    // Returns why the change was refused, or nullptr on success. Called with dishLock and
+    // materialLock held, either of them shared: the counters are updated with compare-and-swap,
+    // so orders on other terminals reserve at the same time.
+    const char* reserveStock(const std::vector<OrderLine>& newLines, const std::vector<OrderLine>& oldLines) {
+        std::vector<StockChange> changes;
+        for (auto& line : newLines) {
+            auto dish = dishIndex.find(line.dishID);
+            if (dish == dishIndex.end()) {
+                return "Dish not found.";
+            }
+            for (auto& ingredient : dishes[dish->second].ingredients) {
+                auto material = materialIndex.find(ingredient.materialID);
+                if (material == materialIndex.end()) {
+                    return "An ingredient is no longer stocked.";
+                }
+                changes.push_back(StockChange{material->second, ingredient.amount * line.quantity});
+            }
+        }
+        for (auto& line : oldLines) {
+            auto dish = dishIndex.find(line.dishID);
+            if (dish == dishIndex.end()) {
+                continue;  // Nothing to return for a dish that no longer exists
+            }
+            for (auto& ingredient : dishes[dish->second].ingredients) {
+                auto material = materialIndex.find(ingredient.materialID);
+                if (material != materialIndex.end()) {
+                    changes.push_back(StockChange{material->second, -ingredient.amount * line.quantity});
+                }
+            }
+        }
+        // Merge the changes per material so each is checked and written once
+        std::sort(changes.begin(), changes.end(), [](const StockChange& a, const StockChange& b) { return a.slot < b.slot; });
+        size_t merged = 0;
+        for (size_t i = 0; i < changes.size(); ++i) {
+            if (merged > 0 && changes[merged - 1].slot == changes[i].slot) {
+                changes[merged - 1].amount += changes[i].amount;
+            } else {
+                changes[merged++] = changes[i];
+            }
+        }
+        changes.resize(merged);
+        // Take material by material. Returned stock reaches the counters only once every take has
+        // succeeded, and only as it is recorded, so undoing a shortfall only ever returns units
+        // and a recorded quantity never drops below its counter.
+        size_t takes = std::stable_partition(changes.begin(), changes.end(),
+                                             [](const StockChange& change) { return change.amount > 0; }) - changes.begin();
+        size_t taken = 0;
+        while (taken < takes && stockCounters[changes[taken].slot]->take(changes[taken].amount)) {
+            taken++;
+        }
+        if (taken < takes) {
+            for (size_t i = 0; i < taken; ++i) {
+                stockCounters[changes[i].slot]->take(-changes[i].amount);
+            }
+            return "Not enough stock.";
+        }
+        // Copy and allocate what the records need before taking stockLock. versionsLive cannot
+        // change meanwhile, since every caller holds an order shard lock exclusively.
+        bool versioned = versionsLive.load(std::memory_order_relaxed);
+        std::vector<StockRecord> records;
+        records.reserve(changes.size());
+        for (auto& change : changes) {
+            records.push_back(StockRecord{stockedMaterial(change.slot), {}, Money(), Money()});
+            if (versioned) {
+                records.back().version = materialVersions.stage(records.back().material);
+            }
+        }
+        bool menuChanged = false;
+        {
+            std::lock_guard<std::mutex> stock(stockLock);
+            for (size_t i = 0; i < changes.size(); ++i) {
+                recordStock(changes[i].slot, changes[i].amount, records[i]);
+                menuChanged = menuChanged || records[i].menuChanged;
+                if (changes[i].amount < 0) {
+                    stockCounters[changes[i].slot]->take(changes[i].amount);
+                }
+            }
+        }
+        if (menuChanged) {
+            std::lock_guard<std::mutex> stock(stockLock);
+            publishMenu();  // From the table as it is now, which may include later orders
+        }
+        for (auto& record : records) {
+            applyMaterialDelta(record.oldValue, record.newValue);
+            journalWrite(JournalOp::PutMaterial, record.material);
+            if (record.warn) {
+                warnLowStock(record.material);
+            }
+        }
+        return nullptr;
+    }
+
+    // Record stock an order took (negative: gave back) in its material and the stock views that
+    // must change with it, and fill in the stock fields of the material's record. Called with
+    // stockLock held. Each order records only its own change, so its commit carries exactly its
+    // own deduction. The record is journaled after stockLock is let go, so records of concurrent
+    // orders can reach the journal out of order; the revision stamped here lets replay keep
+    // only the newest.
+    void recordStock(size_t slot, int amount, StockRecord& record) {
+        Material& material = materials[slot];
+        record.oldValue = material.price * material.quantity;
+        stockLevelIndex.erase(stockLevelKey(material));
+        material.quantity -= amount;
+        stockLevelIndex.insert(stockLevelKey(material));
+        record.menuChanged = servings.setStock(material.materialID, material.quantity);
+        record.newValue = material.price * material.quantity;
+        material.revision++;
+        record.warn = markStockLevel(material);
+        for (Material* copy : {&record.material, record.version ? &record.version.value() : nullptr}) {
+            if (copy != nullptr) {
+                copy->quantity = material.quantity;
+                copy->revision = material.revision;
+                copy->lowStockWarned = material.lowStockWarned;
+            }
+        }
+        if (record.version) {
+            EpochClock::Commit commit(versionClock);
+            materialVersions.put(commit, material.materialID, record.version);
+        }
+    }
+
+    // Place an order: reserve its stock, queue it for the kitchen and record it. Returns why it
+    // was refused, or nullptr on success. Called with dishLock and materialLock held shared,
+    // inside a journal batch.
+    const char* placeOrder(Order order) {
+        OrderShard& shard = shardFor(order.orderID);
+        WriteLock shardWrite(shard.lock);
+        EpochClock::Commit commit(versionClock);  // The order and its stock become visible together
+        if (shard.index.count(order.orderID)) {
+            return "Order ID already exists.";
+        }
+        if (!order.calculateTotalFee(order.totalFee)) {
+            return "Order total is too large.";
+        }
+        if (const char* error = reserveStock(order.lines, {})) {
+            return error;
+        }
+        order.status = OrderStatus::New;
+        {
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            order.sequence = nextOrderSequence++;
+            linkOrder(order);
+        }
+        shard.index[order.orderID] = shard.orders.size();
+        shard.orders.push_back(order);
+        journalPut(JournalOp::PutOrder, order);
+        applyOrderDelta(Money(), order.totalFee);
+        return nullptr;
+    }
+
+    // Commit a batch from the intake ring as one journal write. Producers hear back only once
+    // the batch is journaled.
+    void commitIntake(std::vector<IntakeRequest>& batch) {
+        std::vector<const char*> results;
+        {
+            JournalSync sync(journal);
+            ReadLock dishRead(dishLock);
+            ReadLock materialRead(materialLock);
+            beginJournalBatch();
+            for (auto& request : batch) {
+                results.push_back(placeOrder(std::move(request.order)));
+            }
+            commitJournalBatch();
+        }
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch[i].done.set_value(results[i]);
+        }
+    }
+
+    // The insert helpers below expect the locks their public counterparts take to be held.
+
+    // Insert a new user, returning why it was rejected or nullptr on success
+    const char* insertUser(const User& user) {
+        if (userIndex.count(user.userID)) {
+            return "User ID already exists.";
+        }
+        if (usernameIndex.count(user.username)) {
+            return "Username already exists.";
+        }
+        usernameIndex[user.username] = user.userID;
+        userIndex[user.userID] = users.size();
+        users.push_back(user);
+        journalPut(JournalOp::PutUser, user);
+        return nullptr;
+    }
+
+    // Insert a new material, returning why it was rejected or nullptr on success
+    const char* insertMaterial(const Material& material) {
+        if (materialIndex.count(material.materialID)) {
+            return "Material ID already exists.";
+        }
+        Money value;
+        if (!value.addWithinLimit(material.price, material.quantity)) {
+            return "Price or stock value is too large.";
+        }
+        materialIndex[material.materialID] = materials.size();
+        materials.push_back(material);
+        stockCounters.push_back(std::make_unique<StockCounter>(material.quantity));
+        stockLevelIndex.insert(stockLevelKey(material));
+        refreshServings(material);
+        journalPut(JournalOp::PutMaterial, material);
+        applyMaterialDelta(Money(), material.price * material.quantity);
+        return nullptr;
+    }
+
+    // Insert a new dish, returning why it was rejected or nullptr on success
+    const char* insertDish(const Dish& dish) {
+        if (dishIndex.count(dish.dishID) || dishNameIndex.count(dish.name)) {
+            return "Dish ID or Name already exists.";
+        }
+        for (auto& ingredient : dish.ingredients) {
+            if (!materialIndex.count(ingredient.materialID)) {
+                return "Material not found.";
+            }
+            if (ingredient.amount <= 0) {
+                return "Invalid ingredient amount.";
+            }
+        }
+        Money cost;
+        if (!dish.price.withinLimit() || !ingredientCost(dish.ingredients, cost)) {
+            return "Price or ingredient cost is too large.";
+        }
+        dishIndex[dish.dishID] = dishes.size();
+        dishNameIndex[dish.name] = dish.dishID;
+        dishes.push_back(dish);
+        linkDish(dish);
+        refreshDishCost(dishes.back());
+        refreshServings();
+        journalPut(JournalOp::PutDish, dishes.back());
+        return nullptr;
+    }
+
+    // Insert a new customer, returning why it was rejected or nullptr on success
+    const char* insertCustomer(const Customer& customer) {
+        if (customerIndex.count(customer.customerID)) {
+            return "Customer ID already exists.";
+        }
+        customerIndex[customer.customerID] = customers.size();
+        customers.push_back(customer);
+        journalPut(JournalOp::PutCustomer, customer);
+        return nullptr;
+    }
+
+    // Insert a notification whose ID is known to be free; called with notificationLock held exclusively
+    void insertNotification(const Notification& notification) {
+        notificationIndex[notification.notificationID] = notifications.size();
+        notifications.push_back(notification);
+        nextNotificationID = std::max(nextNotificationID, notification.notificationID + 1);
+        journalPut(JournalOp::PutNotification, notification);
+    }
+
+    // Called after a material's quantity or threshold changes. Sends one stock warning when the
+    // quantity falls to the threshold; further drops stay quiet until the material is restocked.
+    void checkStockLevel(Material& material) {
+        if (markStockLevel(material)) {
+            warnLowStock(material);
+        }
+    }
+
+    // Update the warning flag of a material, returning true if its stock just fell to the threshold
+    static bool markStockLevel(Material& material) {
+        bool warn = material.isLowStock() && !material.lowStockWarned;
+        material.lowStockWarned = material.isLowStock();
+        return warn;
+    }
+
+    // Add a stock warning notification for a material
+    void warnLowStock(const Material& material) {
+        char time[20];
+        std::time_t now = std::time(nullptr);
+        std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M", std::localtime(&now));
+        std::string content = "Material " + std::to_string(material.materialID) + " (" + material.name + ") is low: "
+                            + std::to_string(material.quantity) + " left, threshold " + std::to_string(material.warningThreshold);
+        WriteLock write(notificationLock);
+        insertNotification(Notification(nextNotificationID, "Stock Warning", content, time));
+    }
+
+    // CSV row: id,name,price,quantity,warningThreshold
+    const char* importMaterialRow(int id, const std::vector<std::string>& fields) {
+        Money price;
+        int quantity, warningThreshold;
+        if (fields.size() != 5) {
+            return "Expected 5 fields: id,name,price,quantity,warningThreshold.";
+        }
+        if (!Money::parse(fields[2], price)) {
+            return "Invalid Material Price.";
+        }
+        if (!parseInt(fields[3], quantity)) {
+            return "Invalid Quantity.";
+        }
+        if (!parseInt(fields[4], warningThreshold)) {
+            return "Invalid Warning Threshold.";
+        }
+        return insertMaterial(Material(id, fields[1], price, quantity, warningThreshold));
+    }
+
+    // CSV row: id,name,price,category,materialID[:amount];materialID[:amount];... (amount defaults to 1)
+    const char* importDishRow(int id, const std::vector<std::string>& fields) {
+        Money price;
+        if (fields.size() != 5) {
+            return "Expected 5 fields: id,name,price,category,ingredients.";
+        }
+        if (!Money::parse(fields[2], price)) {
+            return "Invalid Dish Price.";
+        }
+        std::vector<Ingredient> ingredients;
+        size_t start = 0;
+        while (start <= fields[4].size()) {
+            size_t end = fields[4].find(';', start);
+            if (end == std::string::npos) {
+                end = fields[4].size();
+            }
+            std::string item = fields[4].substr(start, end - start);
+            size_t colon = item.find(':');
+            Ingredient ingredient{0, 1};
+            if (!parseInt(item.substr(0, colon), ingredient.materialID)) {
+                return "Invalid Material ID in ingredients.";
+            }
+            if (colon != std::string::npos && !parseInt(item.substr(colon + 1), ingredient.amount)) {
+                return "Invalid ingredient amount.";
+            }
+            ingredients.push_back(ingredient);
+            start = end + 1;
+        }
+        return insertDish(Dish(id, fields[1], price, fields[3], ingredients));
+    }
+
+    // CSV row: id,name,contact,points,discountInfo
+    const char* importCustomerRow(int id, const std::vector<std::string>& fields) {
+        int points;
+        if (fields.size() != 5) {
+            return "Expected 5 fields: id,name,contact,points,discountInfo.";
+        }
+        if (!parseInt(fields[3], points)) {
+            return "Invalid Points.";
+        }
+        return insertCustomer(Customer(id, fields[1], fields[2], points, fields[4]));
+    }
+
+    // CSV row: id,username,password,role
+    const char* importUserRow(int id, const std::vector<std::string>& fields) {
+        Role role;
+        if (fields.size() != 4) {
+            return "Expected 4 fields: id,username,password,role.";
+        }
+        if (!parseRole(fields[3], role)) {
+            return "Invalid Role.";
+        }
+        return insertUser(User(id, fields[1], fields[2], role));
+    }
+
+    // Kinds of journal records; each Put carries the full entity, each Erase only its ID
+    enum class JournalOp : int32_t {
+        PutUser = 1, EraseUser,
+        PutMaterial, EraseMaterial,
+        PutDish, EraseDish,
+        PutCustomer, EraseCustomer,
+        PutOrder, EraseOrder,
+        PutNotification, EraseNotification,
+        Batch                      // Several records applied together
+    };
+
+    // Records held back while the calling thread has a batch open
+    static inline thread_local std::vector<std::string> journalBatch;
+    static inline thread_local bool journalBatchOpen = false;
+
+    // Newest record this thread still has to wait for, and how many JournalSync scopes it is in
+    static inline thread_local uint64_t journalTicket = 0;
+    static inline thread_local int journalSyncDepth = 0;
+
+    // Records written on this thread inside the scope are waited for when the scope ends. Declare
+    // it ahead of the store locks so that no lock is held while the journal syncs.
+    class JournalSync {
+    public:
+        explicit JournalSync(Journal& journal) : journal(journal) {
+            ++journalSyncDepth;
+        }
+
+        ~JournalSync() {
+            if (--journalSyncDepth == 0 && journalTicket != 0) {
+                journal.waitDurable(journalTicket);
+                journalTicket = 0;
+            }
+        }
+
+        JournalSync(const JournalSync&) = delete;
+        JournalSync& operator=(const JournalSync&) = delete;
+
+    private:
+        Journal& journal;
+    };
+
+    // Start grouping journal records so that they reach the journal as one record
+    void beginJournalBatch() {
+        journalBatchOpen = true;
+    }
+
+    // Write the records grouped since beginJournalBatch as a single, all-or-nothing record
+    void commitJournalBatch() {
+        journalBatchOpen = false;
+        if (journalBatch.size() == 1) {
+            writeJournal(journalBatch.front());
+        } else if (!journalBatch.empty()) {
+            BinaryWriter out;
+            out.putInt32(static_cast<int32_t>(JournalOp::Batch));
+            out.putInt32(static_cast<int32_t>(journalBatch.size()));
+            for (auto& record : journalBatch) {
+                out.putString(record);
+            }
+            writeJournal(out.buffer);
+        }
+        journalBatch.clear();
+    }
+
+    void appendJournal(std::string payload) {
+        if (journalBatchOpen) {
+            journalBatch.push_back(std::move(payload));
+        } else {
+            writeJournal(payload);
+        }
+    }
+
+    // Write a record now, in the order the changes were made, and wait for it to become durable
+    // here or, inside a JournalSync scope, once the scope ends
+    void writeJournal(const std::string& payload) {
+        uint64_t ticket = journal.write(payload);
+        if (journalSyncDepth > 0) {
+            journalTicket = std::max(journalTicket, ticket);
+        } else {
+            journal.waitDurable(ticket);
+        }
+    }
+
+    // Publish the new state of a versioned record to report readers. It joins the commit open on
+    // this thread, or becomes a commit of its own.
+    void publishVersion(const Order& order) {
+        if (versionsLive.load(std::memory_order_relaxed)) {
+            EpochClock::Commit commit(versionClock);
+            shardFor(order.orderID).versions.put(commit, order.orderID, order);
+        }
+    }
+
+    void publishVersion(const Material& material) {
+        if (versionsLive.load(std::memory_order_relaxed)) {
+            EpochClock::Commit commit(versionClock);
+            materialVersions.put(commit, material.materialID, material);
+        }
+    }
+
+    void publishVersion(const Dish& dish) {
+        if (versionsLive.load(std::memory_order_relaxed)) {
+            EpochClock::Commit commit(versionClock);
+            dishVersions.put(commit, dish.dishID, dish);
+        }
+    }
+
+    template <typename T>
+    void publishVersion(const T&) {}      // Other stores are read under their locks
+
+    // Publish the removal of a versioned record
+    void publishErase(JournalOp op, int id) {
+        if (!versionsLive.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (op == JournalOp::EraseOrder || op == JournalOp::EraseMaterial || op == JournalOp::EraseDish) {
+            EpochClock::Commit commit(versionClock);
+            if (op == JournalOp::EraseOrder) {
+                shardFor(id).versions.erase(commit, id);
+            } else if (op == JournalOp::EraseMaterial) {
+                materialVersions.erase(commit, id);
+            } else {
+                dishVersions.erase(commit, id);
+            }
+        }
+    }
+
+    // Publish the whole state of the versioned stores as one commit, so no report sees part of
+    // the old state and part of the new; the caller holds at least a read lock on every one
+    void publishAllVersions() {
+        EpochClock::Commit commit(versionClock);
+        materialVersions.replaceAll(commit, materials, [](const Material& m) { return m.materialID; });
+        dishVersions.replaceAll(commit, dishes, [](const Dish& d) { return d.dishID; });
+        for (auto& shard : orderShards) {
+            shard.versions.replaceAll(commit, shard.orders, [](const Order& o) { return o.orderID; });
+        }
+    }
+
+    // A report's pinned view of the versioned stores, taken with pinVersions
+    class ReportView {
+    public:
+        explicit ReportView(RestaurantManagementSystem& system) : system(system), pin(system.versionClock),
+                                                                  epoch(pin.epoch) {}
+        ~ReportView() {
+            system.releaseVersions();
+        }
+        ReportView(const ReportView&) = delete;
+        ReportView& operator=(const ReportView&) = delete;
+
+    private:
+        RestaurantManagementSystem& system;
+        EpochClock::Pin pin;
+
+    public:
+        const uint64_t epoch;          // Epoch the report sees
+    };
+
+    // Pin the latest versions for a report. Chains exist only while reports run: a report that
+    // finds none builds them from the stores, and the last report to finish frees them, so
+    // records are not held twice in between. Writers check versionsLive under their store locks,
+    // which are held shared while it flips.
+    ReportView pinVersions() {
+        for (;;) {
+            // A report counts itself in before looking at versionsLive, and releaseVersions
+            // clears versionsLive before looking at the count, so chains are never freed under
+            // a report
+            versionReaders.fetch_add(1);
+            if (versionsLive.load()) {
+                return ReportView(*this);
+            }
+            versionReaders.fetch_sub(1);
+            std::lock_guard<std::mutex> starting(versionsStartLock);
+            if (!versionsLive.load()) {
+                std::vector<ReadLock> locks = lockAllStores<ReadLock>();
+                publishAllVersions();
+                versionsLive.store(true);
+            }
+        }
+    }
+
+    // Called as a report finishes; the last one frees the chains unless another report came in
+    void releaseVersions() {
+        if (versionReaders.fetch_sub(1) != 1) {
+            return;
+        }
+        std::lock_guard<std::mutex> starting(versionsStartLock);
+        if (!versionsLive.load()) {
+            return;
+        }
+        std::vector<ReadLock> locks = lockAllStores<ReadLock>();
+        versionsLive.store(false);
+        if (versionReaders.load() != 0) {
+            versionsLive.store(true);
+            return;
+        }
+        materialVersions.clear();
+        dishVersions.clear();
+        for (auto& shard : orderShards) {
+            shard.versions.clear();
+        }
+    }
+
+    // Journal the new state of an entity
+    template <typename T>
+    void journalPut(JournalOp op, const T& item) {
+        publishVersion(item);
+        journalWrite(op, item);
+    }
+
+    // Journal the new state of an entity whose version was published separately
+    template <typename T>
+    void journalWrite(JournalOp op, const T& item) {
+        if (!journal.isOpen()) {
+            return;
+        }
+        BinaryWriter out;
+        out.putInt32(static_cast<int32_t>(op));
+        item.serialize(out);
+        appendJournal(std::move(out.buffer));
+    }
+
+    // Journal the removal of an entity
+    void journalErase(JournalOp op, int id) {
+        publishErase(op, id);
+        if (!journal.isOpen()) {
+            return;
+        }
+        BinaryWriter out;
+        out.putInt32(static_cast<int32_t>(op));
+        out.putInt32(id);
+        appendJournal(std::move(out.buffer));
+    }
+
+    // Insert an entity or overwrite the one with the same ID (journal replay)
+    template <typename T, typename GetID>
+    static void upsertSlot(std::vector<T>& store, std::unordered_map<int, size_t>& index, T item, GetID getID) {
+        auto found = index.find(getID(item));
+        if (found != index.end()) {
+            store[found->second] = std::move(item);
+        } else {
+            index[getID(item)] = store.size();
+            store.push_back(std::move(item));
+        }
+    }
+
+    // Erase an entity by ID if present (journal replay)
+    template <typename T, typename GetID>
+    static void eraseByID(std::vector<T>& store, std::unordered_map<int, size_t>& index, int id, GetID getID) {
+        auto found = index.find(id);
+        if (found != index.end()) {
+            eraseSlot(store, index, found->second, getID);
+        }
+    }
+
+    // Apply one journal record to the stores; secondary indexes are rebuilt after replay
+    void applyJournalRecord(BinaryReader& in) {
+        auto userID = [](const User& u) { return u.userID; };
+        auto materialID = [](const Material& m) { return m.materialID; };
+        auto dishID = [](const Dish& d) { return d.dishID; };
+        auto customerID = [](const Customer& c) { return c.customerID; };
+        auto orderID = [](const Order& o) { return o.orderID; };
+        auto notificationID = [](const Notification& n) { return n.notificationID; };
+        switch (static_cast<JournalOp>(in.getInt32())) {
+            case JournalOp::PutUser: upsertSlot(users, userIndex, User::deserialize(in), userID); break;
+            case JournalOp::EraseUser: eraseByID(users, userIndex, in.getInt32(), userID); break;
+            case JournalOp::PutMaterial: {
+                Material material = Material::deserialize(in);
+                auto found = materialIndex.find(material.materialID);
+                if (found == materialIndex.end() || materials[found->second].revision <= material.revision) {
+                    upsertSlot(materials, materialIndex, std::move(material), materialID);
+                }
+                break;
+            }
+            case JournalOp::EraseMaterial: eraseByID(materials, materialIndex, in.getInt32(), materialID); break;
+            case JournalOp::PutDish: upsertSlot(dishes, dishIndex, Dish::deserialize(in), dishID); break;
+            case JournalOp::EraseDish: eraseByID(dishes, dishIndex, in.getInt32(), dishID); break;
+            case JournalOp::PutCustomer: upsertSlot(customers, customerIndex, Customer::deserialize(in), customerID); break;
+            case JournalOp::EraseCustomer: eraseByID(customers, customerIndex, in.getInt32(), customerID); break;
+            case JournalOp::PutOrder: {
+                Order order = Order::deserialize(in);
+                OrderShard& shard = shardFor(order.orderID);
+                upsertSlot(shard.orders, shard.index, std::move(order), orderID);
+                break;
+            }
+            case JournalOp::EraseOrder: {
+                int id = in.getInt32();
+                OrderShard& shard = shardFor(id);
+                eraseByID(shard.orders, shard.index, id, orderID);
+                break;
+            }
+            case JournalOp::PutNotification: upsertSlot(notifications, notificationIndex, Notification::deserialize(in), notificationID); break;
+            case JournalOp::EraseNotification: eraseByID(notifications, notificationIndex, in.getInt32(), notificationID); break;
+            case JournalOp::Batch: {
+                int32_t count = in.getInt32();
+                for (int32_t i = 0; i < count; ++i) {
+                    std::string record = in.getString();
+                    BinaryReader nested(record.data(), record.size());
+                    applyJournalRecord(nested);
+                }
+                break;
+            }
+            default: throw std::runtime_error("Corrupt record");
+        }
+    }
+
+    // Snapshot file layout: magic, format version, then each store as a count and its records
+    static constexpr char SNAPSHOT_MAGIC[8] = {'R', 'M', 'S', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr int32_t SNAPSHOT_VERSION = RECORD_FORMAT_VERSION;
+
+    template <typename T>
+    static void writeStore(BinaryWriter& out, const std::vector<T>& store) {
+        out.putInt32(static_cast<int32_t>(store.size()));
+        for (auto& item : store) {
+            item.serialize(out);
+        }
+    }
+
+    template <typename T>
+    static void readStore(BinaryReader& in, std::vector<T>& store) {
+        int32_t count = in.getInt32();
+        if (count < 0 || static_cast<size_t>(count) > in.remaining()) {
+            throw std::runtime_error("Corrupt record");
+        }
+        store.reserve(count);
+        for (int32_t i = 0; i < count; ++i) {
+            store.push_back(T::deserialize(in));
+        }
+    }
+
+public:
+    // Stop the committer and the kitchen first: they write to the stores below them
+    ~RestaurantManagementSystem() {
+        intake.reset();
+        kitchen.reset();
+    }
+
+    // Login function to authenticate a user; returns the token of a new session, or NO_SESSION
+    SessionToken login(std::string username, std::string password) {
+        ReadLock read(userLock);
+        auto owner = usernameIndex.find(username);
+        if (owner == usernameIndex.end()) {
+            return NO_SESSION;
+        }
+        User& user = users[userIndex.at(owner->second)];
+        if (!user.login(username, password)) {
+            return NO_SESSION;
+        }
+        WriteLock write(sessionLock);
+        SessionToken token;
+        do {
+            if (!secureRandom(&token, sizeof(token))) {
+                return NO_SESSION;  // No unpredictable token can be issued
+            }
+        } while (token == NO_SESSION || sessions.count(token));
+        sessions[token] = Session{owner->second, permissionsFor(user.getRole())};
+        return token;
+    }
+
+    // End a session; its token is no longer accepted
+    void logout(SessionToken session) {
+        WriteLock write(sessionLock);
+        sessions.erase(session);
+    }
+
+    // Register a new user in the system
+    void registerUser(User user) {
+        JournalSync sync(journal);
+        WriteLock write(userLock);
+        if (const char* error = insertUser(user)) {
+            std::cout << error << " Please try again.\n";
+            return;
+        }
+        std::cout << "User registered successfully.\n";
+    }
+
+    // Add a new user to the system
+    void addUser(SessionToken session, User user) {
+        if (!allowed(session, ManageUsers)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        WriteLock write(userLock);
+        if (const char* error = insertUser(user)) {
+            std::cout << error << " Returning to main menu.\n";
+        }
+    }
+
+    // Add a new material to the system
+    void addMaterial(SessionToken session, Material material) {
+        if (!allowed(session, ManageMaterials)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        ReadLock dishRead(dishLock);  // The menu view is rebuilt from the dishes
+        WriteLock materialWrite(materialLock);
+        if (const char* error = insertMaterial(material)) {
+            std::cout << error << " Returning to main menu.\n";
+        }
+    }
+
+    // Add a new dish to the system
+    void addDish(SessionToken session, Dish dish) {
+        if (!allowed(session, ManageDishes)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        WriteLock dishWrite(dishLock);
+        WriteLock materialWrite(materialLock);
+        if (const char* error = insertDish(dish)) {
+            std::cout << error << " Returning to main menu.\n";
+        }
+    }
+
+    // Add a new customer to the system
+    void addCustomer(SessionToken session, Customer customer) {
+        if (!allowed(session, ManageCustomers)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        WriteLock write(customerLock);
+        if (const char* error = insertCustomer(customer)) {
+            std::cout << error << " Returning to main menu.\n";
+        }
+    }
+
+    // Bulk import materials, dishes, customers or users from a CSV file, one entity per row.
+    // Rows follow the fields of the Add Menu; dish ingredients are materialID:amount separated by ';'.
+    // Rows that fail are reported and skipped; the rest of the file is still imported. Rows go in
+    // in chunks, each journaled as one record; the store locks are let go between chunks.
+    void importCSV(SessionToken session, const std::string& kind, const std::string& path) {
+        unsigned permission = 0;
+        if (kind == "materials") {
+            permission = ManageMaterials;
+        } else if (kind == "dishes") {
+            permission = ManageDishes;
+        } else if (kind == "customers") {
+            permission = ManageCustomers;
+        } else if (kind == "users") {
+            permission = ManageUsers;
+        }
+        if (permission == 0) {
+            std::cout << "Unknown import type. Expected materials, dishes, customers or users.\n";
+            return;
+        }
+        if (!allowed(session, permission)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        CsvReader reader(path);
+        if (!reader.isOpen()) {
+            std::cout << "Could not open " << path << ".\n";
+            return;
+        }
+        ReadLock dishRead(dishLock, std::defer_lock);
+        WriteLock userWrite(userLock, std::defer_lock), dishWrite(dishLock, std::defer_lock);
+        WriteLock materialWrite(materialLock, std::defer_lock), customerWrite(customerLock, std::defer_lock);
+        std::vector<std::string> fields;
+        int row = 0, imported = 0, failed = 0;
+        bool more = true;
+        while (more) {
+            // Take the locks of the stores the rows go into for one chunk
+            if (kind == "users") {
+                userWrite.lock();
+            } else if (kind == "dishes") {
+                dishWrite.lock();
+                materialWrite.lock();
+            } else if (kind == "materials") {
+                dishRead.lock();
+                materialWrite.lock();
+            } else {
+                customerWrite.lock();
+            }
+            servingsDeferred = materialWrite.owns_lock();  // Orders read it with materialLock shared
+            beginJournalBatch();
+            int chunkRows = 0, chunkImported = 0;
+            while (chunkRows < IMPORT_CHUNK_ROWS && (more = reader.nextRow(fields))) {
+                ++row;
+                ++chunkRows;
+                if (fields.size() == 1 && fields[0].empty()) {
+                    continue;  // Blank line
+                }
+                int id;
+                if (!parseInt(fields[0], id)) {
+                    if (row == 1) {
+                        continue;  // Header line
+                    }
+                    std::cout << "Row " << row << ": Invalid ID.\n";
+                    ++failed;
+                    continue;
+                }
+                const char* error = kind == "materials" ? importMaterialRow(id, fields)
+                                  : kind == "dishes" ? importDishRow(id, fields)
+                                  : kind == "customers" ? importCustomerRow(id, fields)
+                                  : importUserRow(id, fields);
+                if (error != nullptr) {
+                    std::cout << "Row " << row << ": " << error << std::endl;
+                    ++failed;
+                } else {
+                    ++chunkImported;
+                }
+            }
+            commitJournalBatch();
+            if (materialWrite.owns_lock()) {
+                servingsDeferred = false;
+                if (chunkImported > 0) {
+                    refreshServings();
+                }
+            }
+            imported += chunkImported;
+            for (auto* lock : {&userWrite, &dishWrite, &materialWrite, &customerWrite}) {
+                if (lock->owns_lock()) {
+                    lock->unlock();
+                }
+            }
+            if (dishRead.owns_lock()) {
+                dishRead.unlock();
+            }
+        }
+        std::cout << "Imported " << imported << " rows, " << failed << " failed.\n";
+    }
+
+    // Add a new order to the system
+    void addOrder(SessionToken session, Order order) {
+        if (!allowed(session, PlaceOrders)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        ReadLock dishRead(dishLock);
+        ReadLock materialRead(materialLock);  // Stock is reserved through the counters
+        OrderShard& shard = shardFor(order.orderID);
+        if (contains(shard.lock, shard.index, order.orderID)) {
+            std::cout << "Order ID already exists. Returning to main menu.\n";
+            return;
+        }
+        beginJournalBatch();
+        const char* error = placeOrder(std::move(order));
+        commitJournalBatch();
+        if (error) {
+            std::cout << error << " Order rejected.\n";
+            return;
+        }
+        std::cout << "Order added successfully.\n";
+    }
+
+    // Start the committer that drains the order intake ring
+    void startIntake(size_t capacity, Backpressure whenFull) {
+        intake = std::make_unique<OrderIntake>(capacity, whenFull,
+                                               [this](std::vector<IntakeRequest>& batch) { commitIntake(batch); });
+    }
+
+    // Queue an order through the intake ring; the future gives nullptr once the order is
+    // committed, or why it was refused
+    std::future<const char*> submitOrder(SessionToken session, Order order) {
+        if (!allowed(session, PlaceOrders) || !intake) {
+            std::promise<const char*> refused;
+            refused.set_value(intake ? "Permission denied." : "Order intake is not running.");
+            return refused.get_future();
+        }
+        return intake->submit(std::move(order));
+    }
+
+    // Add a new notification to the system
+    void addNotification(SessionToken session, Notification notification) {
+        if (!allowed(session, ManageNotifications)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        WriteLock write(notificationLock);
+        if (notificationIndex.count(notification.notificationID)) {
+            std::cout << "Notification ID already exists. Returning to main menu.\n";
+            return;
+        }
+        insertNotification(notification);
+    }
+
+    // Display all users in the system
+    void displayUsers(SessionToken session) {
+        if (!allowed(session, ManageUsers)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReadLock read(userLock);
+        if (users.empty()) {
+            std::cout << "No users available.\n";
+        } else {
+            for (auto& user : users) {
+                user.display();
+            }
+        }
+    }
+
+    // Display all materials in the system
+    void displayMaterials(SessionToken session) {
+        if (!allowed(session, ViewMaterials)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReportView view = pinVersions();
+        bool any = false;
+        materialVersions.forEach(view.epoch, [&](const Material& material) {
+            material.display();
+            any = true;
+        });
+        if (!any) {
+            std::cout << "No materials available.\n";
+        }
+    }
+
+    // Display up to count materials at or below their warning threshold, furthest below first
+    void displayReorderList(SessionToken session, int count) {
+        if (!allowed(session, ViewMaterials)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReadLock read(materialLock);
+        std::lock_guard<std::mutex> stock(stockLock);
+        int shown = 0;
+        for (auto level = stockLevelIndex.begin(); level != stockLevelIndex.end() && shown < count; ++level, ++shown) {
+            if (level->first > 0) {
+                break;  // Everything after this is above its threshold
+            }
+            const Material& material = materials[materialIndex.at(level->second)];
+            std::cout << "Shortfall: " << -level->first << ", ";
+            material.display();
+        }
+        if (shown == 0) {
+            std::cout << "No materials need reordering.\n";
+        }
+    }
+
+    // Display the dishes that use a material
+    void displayDishesUsingMaterial(SessionToken session, int materialID) {
+        if (!allowed(session, ViewMaterials)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReadLock read(dishLock);
+        auto usage = dishesByMaterial.find(materialID);
+        if (usage == dishesByMaterial.end()) {
+            std::cout << "No dishes use this material.\n";
+            return;
+        }
+        for (int dishID : usage->second) {
+            dishes[dishIndex.at(dishID)].display();
+        }
+    }
+
+    // Display the price, ingredient cost and margin of every dish
+    void displayMenuProfitability(SessionToken session) {
+        if (!allowed(session, ManageDishes)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReportView view = pinVersions();
+        bool any = false;
+        dishVersions.forEach(view.epoch, [&](const Dish& dish) {
+            std::cout << "Dish ID: " << dish.dishID << ", Name: " << dish.name << ", Price: " << dish.price
+                      << ", Ingredient Cost: " << dish.ingredientCost << ", Margin: " << dish.getMargin() << std::endl;
+            any = true;
+        });
+        if (!any) {
+            std::cout << "No dishes available.\n";
+        }
+    }
+
+    // Display how many servings of each dish the current stock supports
+    void displayServingsAvailable(SessionToken session) {
+        if (!allowed(session, ViewMaterials)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReadLock dishRead(dishLock);
+        ReadLock materialRead(materialLock);
+        std::lock_guard<std::mutex> stock(stockLock);
+        if (dishes.empty()) {
+            std::cout << "No dishes available.\n";
+            return;
+        }
+        for (size_t i = 0; i < dishes.size(); ++i) {
+            std::cout << "Dish ID: " << dishes[i].dishID << ", Name: " << dishes[i].name << ", Servings: ";
+            int available = servings.available(i);
+            if (available == ServingsTable::UNLIMITED) {
+                std::cout << "unlimited" << std::endl;
+            } else {
+                std::cout << available << std::endl;
+            }
+        }
+    }
+
+    // Display a dish with its ingredients; called with materialLock held
+    void displayDishDetails(const Dish& dish) {
+        dish.display();
+        std::cout << "Ingredients: " << std::endl;
+        for (auto& ingredient : dish.ingredients) {
+            std::cout << ingredient.amount << " x ";
+            auto found = materialIndex.find(ingredient.materialID);
+            if (found == materialIndex.end()) {
+                std::cout << "Material ID: " << ingredient.materialID << " (removed)" << std::endl;
+            } else {
+                stockedMaterial(found->second).display();
+            }
+        }
+    }
+
+    // Display the dishes that can be ordered right now; staff also see the ones out of stock
+    void displayDishes(SessionToken session) {
+        ReadLock dishRead(dishLock);
+        ReadLock materialRead(materialLock);
+        std::shared_ptr<const AvailableMenu> menu = std::atomic_load(&availableMenu);
+        bool showUnavailable = allowed(session, ManageDishes) && menu->dishes.size() < dishes.size();
+        if (menu->dishes.empty() && !showUnavailable) {
+            std::cout << "No dishes available.\n";
+            return;
+        }
+        for (auto& dish : menu->dishes) {
+            displayDishDetails(dish);
+        }
+        if (showUnavailable) {
+            std::cout << "Out of stock:" << std::endl;
+            for (auto& dish : dishes) {
+                if (!menu->dishIndex.count(dish.dishID)) {
+                    displayDishDetails(dish);
+                }
+            }
+        }
+    }
+
+    // Display all customers in the system
+    void displayCustomers(SessionToken session) {
+        if (!allowed(session, ManageCustomers)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReadLock read(customerLock);
+        if (customers.empty()) {
+            std::cout << "No customers available.\n";
+        } else {
+            for (auto& customer : customers) {
+                customer.display();
+            }
+        }
+    }
+
+    // Display all orders in the system
+    void displayOrders(SessionToken session) {
+        if (!allowed(session, ManageOrders)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        ReportView view = pinVersions();
+        bool any = false;
+        for (auto& shard : orderShards) {
+            shard.versions.forEach(view.epoch, [&](const Order& order) {
+                order.display();
+                any = true;
+            });
+        }
+        if (!any) {
+            std::cout << "No orders available.\n";
+        }
+    }
+
+    // Display the amount a customer owes for their unpaid orders and record them as paid
+    void checkout(SessionToken session, int customerID) {
+        if (!allowed(session, Checkout)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        std::vector<int> orderIDs;
+        {
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            auto entry = ordersByCustomer.find(customerID);
+            if (entry == ordersByCustomer.end()) {
+                std::cout << "No unpaid orders for this customer.\n";
+                return;
+            }
+            orderIDs = entry->second.unpaidIDs;
+        }
+        // Shard locks come before the tracking lock, so settle the orders one at a time
+        int settled = 0;
+        Money total;
+        beginJournalBatch();
+        for (int orderID : orderIDs) {
+            OrderShard& shard = shardFor(orderID);
+            WriteLock write(shard.lock);
+            Order* order = findOrder(shard, orderID);
+            if (order == nullptr || order->paid || order->customerID != customerID) {
+                continue;  // Settled, deleted or moved to another customer meanwhile
+            }
+            {
+                std::lock_guard<std::mutex> tracking(orderTrackingLock);
+                unlinkOrder(*order);
+                order->paid = true;
+                linkOrder(*order);
+            }
+            journalPut(JournalOp::PutOrder, *order);
+            settled++;
+            total += order->totalFee;
+        }
+        commitJournalBatch();
+        if (settled == 0) {
+            std::cout << "No unpaid orders for this customer.\n";
+            return;
+        }
+        std::cout << "Unpaid Orders: " << settled << ", Total Fee: " << total << std::endl;
+        std::cout << "Payment recorded.\n";
+    }
+
+    // Start the station workers and hand them the orders that were in preparation when the
+    // system was last stopped
+    void startKitchen(int stationsPerKind, std::chrono::milliseconds prepTime,
+                      std::chrono::milliseconds batchWindow, int maxBatchServings) {
+        kitchen.reset();
+        prepTasksLeft.clear();
+        kitchen = std::make_unique<KitchenScheduler>(stationsPerKind, prepTime, batchWindow, maxBatchServings,
+                                                     [this](const std::vector<int>& finished) { finishTasks(finished); });
+        ReadLock dishRead(dishLock);
+        for (auto& shard : orderShards) {
+            ReadLock read(shard.lock);
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            for (auto& order : shard.orders) {
+                if (order.status == OrderStatus::InPreparation) {
+                    dispatchOrder(order);
+                }
+            }
         }
-        customers.push_back(customer);
     }
 
-    // Add a new order to the system
-    void addOrder(Order order) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Customer") {
+    // Display the load of every kitchen station
+    void displayStations(SessionToken session) {
+        if (!allowed(session, PrepareOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        if (std::find_if(orders.begin(), orders.end(), [&](const Order& o) { return o.orderID == order.orderID; }) != orders.end()) {
-            std::cout << "Order ID already exists. Returning to main menu.\n";
+        if (!kitchen) {
+            std::cout << "Kitchen is not running.\n";
             return;
         }
-        orders.push_back(order);
+        int number = 1;
+        for (auto& station : kitchen->stats()) {
+            std::cout << "Station " << number++ << ": " << stationName(station.kind) << ", Queued: " << station.queued
+                      << ", Prepared: " << station.prepared << ", Stolen: " << station.stolen << std::endl;
+        }
     }
 
-    // Add a new notification to the system
-    void addNotification(Notification notification) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    // Display how line items were merged into cook batches and how long batching held them
+    void displayBatchingStats(SessionToken session) {
+        if (!allowed(session, PrepareOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        if (std::find_if(notifications.begin(), notifications.end(), [&](const Notification& n) { return n.notificationID == notification.notificationID; }) != notifications.end()) {
-            std::cout << "Notification ID already exists. Returning to main menu.\n";
+        if (!kitchen) {
+            std::cout << "Kitchen is not running.\n";
             return;
         }
-        notifications.push_back(notification);
+        KitchenScheduler::BatchStats stats = kitchen->batchStats();
+        if (!kitchen->batchingEnabled()) {
+            std::cout << "Batching is off; every line item is cooked on its own.\n";
+        }
+        if (stats.batches == 0) {
+            std::cout << "No batches cooked yet.\n";
+            return;
+        }
+        std::cout << "Batches: " << stats.batches << ", Line Items: " << stats.items
+                  << ", Average Batch Size: " << static_cast<double>(stats.items) / stats.batches
+                  << ", Largest Batch: " << stats.largest << std::endl;
+        std::cout << "Average Batching Wait: " << stats.totalWaitMs / stats.items << " ms"
+                  << ", Longest Batching Wait: " << stats.longestWaitMs << " ms" << std::endl;
     }
 
-    // Display all users in the system
-    void displayUsers() {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    // Display the kitchen queue, next order to prepare first
+    void displayKitchenQueue(SessionToken session) {
+        if (!allowed(session, PrepareOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        if (users.empty()) {
-            std::cout << "No users available.\n";
-        } else {
-            for (auto& user : users) {
-                user.display();
+        // Copy the queue so no shard lock is taken while holding the tracking lock
+        std::vector<int> queued;
+        {
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            for (auto& ticket : kitchenQueue) {
+                queued.push_back(ticket.orderID);
             }
         }
-    }
-
-    // Display all materials in the system
-    void displayMaterials() {
-        if (loggedInUser == nullptr || (loggedInUser->getRole() != "Admin" && loggedInUser->getRole() != "Chef")) {
-            std::cout << "Permission denied.\n";
+        if (queued.empty()) {
+            std::cout << "Kitchen queue is empty.\n";
             return;
         }
-        if (materials.empty()) {
-            std::cout << "No materials available.\n";
-        } else {
-            for (auto& material : materials) {
-                material.display();
+        for (int orderID : queued) {
+            OrderShard& shard = shardFor(orderID);
+            ReadLock read(shard.lock);
+            Order* order = findOrder(shard, orderID);
+            if (order == nullptr) {
+                continue;  // Deleted since the queue was copied
             }
-        }
-    }
-
-    // Display all dishes in the system
-    void displayDishes() {
-        if (dishes.empty()) {
-            std::cout << "No dishes available.\n";
-        } else {
-            for (auto& dish : dishes) {
-                dish.display();
+            order->display();
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            auto left = prepTasksLeft.find(orderID);
+            if (left != prepTasksLeft.end()) {
+                std::cout << "Prep tasks remaining: " << left->second << std::endl;
             }
         }
     }
 
-    // Display all customers in the system
-    void displayCustomers() {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    // Take the next order that has not been started and put it in preparation
+    void startNextOrder(SessionToken session) {
+        if (!allowed(session, PrepareOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        if (customers.empty()) {
-            std::cout << "No customers available.\n";
-        } else {
-            for (auto& customer : customers) {
-                customer.display();
+        JournalSync sync(journal);
+        ReadLock dishRead(dishLock);
+        for (;;) {
+            int orderID;
+            {
+                std::lock_guard<std::mutex> tracking(orderTrackingLock);
+                if (kitchenQueue.empty() || kitchenQueue.begin()->started) {
+                    std::cout << "No orders waiting.\n";
+                    return;
+                }
+                orderID = kitchenQueue.begin()->orderID;
+            }
+            OrderShard& shard = shardFor(orderID);
+            WriteLock write(shard.lock);
+            Order* order = findOrder(shard, orderID);
+            if (order == nullptr || order->status != OrderStatus::New) {
+                continue;  // Another terminal took or removed it first
             }
+            changeOrderStatus(*order, OrderStatus::InPreparation);
+            std::cout << "Started order:\n";
+            order->display();
+            return;
         }
     }
 
-    // Display all orders in the system
-    void displayOrders() {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    // Move an order to a new status
+    void updateOrderStatus(SessionToken session, int orderID, const std::string& statusText) {
+        if (!allowed(session, PrepareOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        if (orders.empty()) {
-            std::cout << "No orders available.\n";
-        } else {
-            for (auto& order : orders) {
-                order.display();
-            }
+        OrderStatus status;
+        if (!parseOrderStatus(statusText, status)) {
+            std::cout << "Invalid status. Expected New, InPreparation or Completed.\n";
+            return;
+        }
+        JournalSync sync(journal);
+        ReadLock dishRead(dishLock);
+        OrderShard& shard = shardFor(orderID);
+        WriteLock write(shard.lock);
+        Order* order = findOrder(shard, orderID);
+        if (order == nullptr) {
+            std::cout << "Order ID not found. Returning to main menu.\n";
+            return;
         }
+        if (!isValidTransition(order->status, status)) {
+            std::cout << "Cannot change an order from " << statusName(order->status) << " to " << statusName(status)
+                      << ". Returning to main menu.\n";
+            return;
+        }
+        changeOrderStatus(*order, status);
+        std::cout << "Order status updated successfully.\n";
     }
 
-    void displayTotalFee() {
-        std::cout<<loggedInUser->getRole();
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Customer") 
-        {
+    // Change the kitchen priority of an order that is not yet completed
+    void setOrderPriority(SessionToken session, int orderID, int priority) {
+        if (!allowed(session, PrepareOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        if (orders.empty()) {
-            std::cout << "No orders available.\n";
+        OrderShard& shard = shardFor(orderID);
+        JournalSync sync(journal);
+        WriteLock write(shard.lock);
+        Order* order = findOrder(shard, orderID);
+        if (order == nullptr) {
+            std::cout << "Order ID not found. Returning to main menu.\n";
+            return;
         }
-        else {
-            for (auto& order : orders) {
-                order.display2();
-            }
+        if (order->status == OrderStatus::Completed) {
+            std::cout << "Order is already completed. Returning to main menu.\n";
+            return;
         }
+        {
+            std::lock_guard<std::mutex> tracking(orderTrackingLock);
+            unlinkOrder(*order);
+            order->priority = priority;
+            linkOrder(*order);
+        }
+        journalPut(JournalOp::PutOrder, *order);
+        std::cout << "Order priority updated successfully.\n";
     }
 
     // Display all notifications in the system
-    void displayNotifications() {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void displayNotifications(SessionToken session) {
+        if (!allowed(session, ManageNotifications)) {
             std::cout << "Permission denied.\n";
             return;
         }
+        ReadLock read(notificationLock);
         if (notifications.empty()) {
             std::cout << "No notifications available.\n";
         } else {
@@ -412,80 +4170,274 @@ public:
     }
 
     // Calculate and display financial information
-    void calculateFinance() {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void calculateFinance(SessionToken session) {
+        if (!allowed(session, ViewFinance)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        if (orders.empty() || materials.empty()) {
+        // The totals are kept up to date by the writers; the stores are only read to check there
+        // is something to report on, and when verifying
+        bool anyOrders = false, anyMaterials;
+        {
+            ReportView view = pinVersions();
+            for (auto& shard : orderShards) {
+                anyOrders = anyOrders || shard.versions.any(view.epoch);
+            }
+            anyMaterials = materialVersions.any(view.epoch);
+        }
+        if (!anyOrders || !anyMaterials) {
             std::cout << "Not enough data to calculate finance.\n";
-        } else {
-            finance.calculateFinance(orders, materials);
+            return;
+        }
+        if (!verifyFinance) {
+            std::lock_guard<std::mutex> lock(financeLock);
             finance.display();
+            return;
+        }
+        // Verification compares against the live stores, so it holds their locks
+        ReadLock materialRead(materialLock);
+        std::vector<ReadLock> shardReads;
+        for (auto& shard : orderShards) {
+            shardReads.emplace_back(shard.lock);
+        }
+        std::lock_guard<std::mutex> lock(financeLock);
+        finance.display();
+        Finance recomputed;
+        recomputed.calculateFinance(totalOrderFees(), materials);
+        if (recomputed.matches(finance)) {
+            std::cout << "Finance verified against full recompute.\n";
+        } else {
+            std::cout << "Finance mismatch, recomputed totals: ";
+            recomputed.display();
+        }
+    }
+
+    // Enable or disable cross-checking finance against a full recompute
+    void setFinanceVerification(bool enabled) {
+        verifyFinance = enabled;
+    }
+
+    // Write the whole system to a snapshot file, replacing it atomically
+    bool saveSnapshot(const std::string& path) {
+        // Readers keep running; writers wait until the journal has been truncated below
+        std::vector<ReadLock> locks = lockAllStores<ReadLock>();
+        BinaryWriter out;
+        out.buffer.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        out.putInt32(SNAPSHOT_VERSION);
+        writeStore(out, users);
+        writeStore(out, materials);
+        writeStore(out, dishes);
+        writeStore(out, customers);
+        size_t orderCount = 0;
+        for (auto& shard : orderShards) {
+            orderCount += shard.orders.size();
+        }
+        out.putInt32(static_cast<int32_t>(orderCount));
+        for (auto& shard : orderShards) {
+            for (auto& order : shard.orders) {
+                order.serialize(out);
+            }
+        }
+        writeStore(out, notifications);
+
+        // The snapshot must be on disk, under its final name, before the journal records it
+        // replaces are dropped
+        std::string tempPath = path + ".tmp";
+        if (!writeFileDurably(tempPath, out.buffer)) {
+            std::cout << "Failed to write snapshot " << tempPath << ".\n";
+            return false;
+        }
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+            std::cout << "Failed to replace snapshot " << path << ".\n";
+            return false;
+        }
+        if (!syncDirectoryOf(path)) {
+            std::cout << "Failed to sync the directory of snapshot " << path << "; keeping the journal.\n";
+            return false;
+        }
+        // Everything journaled so far is now in the snapshot
+        if (!journal.truncate()) {
+            std::cout << "Snapshot saved, but the journal could not be reset: " << std::strerror(errno) << ".\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Replay a journal over the loaded state, then keep appending every mutation to it
+    size_t openJournal(const std::string& path, Durability durability) {
+        std::vector<WriteLock> locks = lockAllStores<WriteLock>();
+        size_t replayed = Journal::replay(path, [&](BinaryReader& in) { applyJournalRecord(in); });
+        if (replayed > 0) {
+            rebuildIndexes();
+        }
+        if (!journal.open(path, durability)) {
+            std::cout << "Could not open journal " << path << ".\n";
+        }
+        return replayed;
+    }
+
+    // Save a snapshot on request of a logged-in user
+    void saveSnapshotAs(SessionToken session, const std::string& path) {
+        if (!allowed(session, ManageSystem)) {
+            std::cout << "Permission denied.\n";
+            return;
+        }
+        if (saveSnapshot(path)) {
+            std::cout << "Snapshot saved.\n";
+        }
+    }
+
+    // Replace the whole system with the contents of a snapshot file, if it exists
+    bool loadSnapshot(const std::string& path) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            return false;
+        }
+        std::vector<User> loadedUsers;
+        std::vector<Material> loadedMaterials;
+        std::vector<Dish> loadedDishes;
+        std::vector<Customer> loadedCustomers;
+        std::array<std::vector<Order>, ORDER_SHARDS> loadedShards;
+        std::vector<Notification> loadedNotifications;
+        try {
+            if (file.size() < sizeof(SNAPSHOT_MAGIC) ||
+                std::memcmp(file.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+                throw std::runtime_error("Not a snapshot file");
+            }
+            BinaryReader in(file.data() + sizeof(SNAPSHOT_MAGIC), file.size() - sizeof(SNAPSHOT_MAGIC));
+            in.formatVersion = in.getInt32();
+            if (in.formatVersion < 1 || in.formatVersion > SNAPSHOT_VERSION) {
+                throw std::runtime_error("Unsupported snapshot version");
+            }
+            readStore(in, loadedUsers);
+            readStore(in, loadedMaterials);
+            readStore(in, loadedDishes);
+            readStore(in, loadedCustomers);
+            // Orders go straight to their shards; IDs spread evenly, so each shard gets its share
+            int32_t orderCount = in.getInt32();
+            if (orderCount < 0 || static_cast<size_t>(orderCount) > in.remaining()) {
+                throw std::runtime_error("Corrupt record");
+            }
+            for (auto& shard : loadedShards) {
+                shard.reserve(orderCount / ORDER_SHARDS + 1);
+            }
+            for (int32_t i = 0; i < orderCount; ++i) {
+                Order order = Order::deserialize(in);
+                loadedShards[shardOf(order.orderID)].push_back(std::move(order));
+            }
+            readStore(in, loadedNotifications);
+        } catch (const std::runtime_error& e) {
+            std::cout << "Could not load snapshot " << path << ": " << e.what() << std::endl;
+            return false;
+        }
+        std::vector<WriteLock> locks = lockAllStores<WriteLock>();
+        users.swap(loadedUsers);
+        materials.swap(loadedMaterials);
+        dishes.swap(loadedDishes);
+        customers.swap(loadedCustomers);
+        for (size_t i = 0; i < ORDER_SHARDS; ++i) {
+            orderShards[i].orders.swap(loadedShards[i]);
         }
+        notifications.swap(loadedNotifications);
+        {
+            WriteLock write(sessionLock);
+            sessions.clear();  // Sessions name users of the replaced state
+        }
+        rebuildIndexes();
+        return true;
     }
 
     // Get material by its ID
     Material getMaterialByID(int id) {
-        for (auto& material : materials) {
-            if (material.materialID == id) {
-                return material;
-            }
+        ReadLock read(materialLock);
+        auto found = materialIndex.find(id);
+        if (found == materialIndex.end()) {
+            throw std::runtime_error("Material not found");
         }
-        throw std::runtime_error("Material not found");
+        return stockedMaterial(found->second);
     }
 
     // Get dish by its ID
     Dish getDishByID(int id) {
-        for (auto& dish : dishes) {
-            if (dish.dishID == id) {
-                return dish;
-            }
+        ReadLock read(dishLock);
+        auto found = dishIndex.find(id);
+        if (found == dishIndex.end()) {
+            throw std::runtime_error("Dish not found");
+        }
+        return dishes[found->second];
+    }
+
+    // Get a dish that can be ordered right now, read from the available menu
+    Dish getAvailableDish(int id) {
+        std::shared_ptr<const AvailableMenu> menu = std::atomic_load(&availableMenu);
+        auto found = menu->dishIndex.find(id);
+        if (found == menu->dishIndex.end()) {
+            throw std::runtime_error(contains(dishLock, dishIndex, id) ? "Dish is out of stock" : "Dish not found");
         }
-        throw std::runtime_error("Dish not found");
+        return menu->dishes[found->second];
     }
 
     // Modify a user by its ID
-    void modifyUser(int userID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void modifyUser(SessionToken session, int userID) {
+        if (!allowed(session, ManageUsers)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::find_if(users.begin(), users.end(), [&](const User& u) { return u.userID == userID; });
-        if (it == users.end()) {
+        if (!contains(userLock, userIndex, userID)) {
             std::cout << "User ID not found. Returning to main menu.\n";
             return;
         }
-        std::string username, password, role;
+        std::string username, password, roleText;
         std::cout << "Enter new Username: ";
         std::cin >> username;
         std::cout << "Enter new Password: ";
         std::cin >> password;
         std::cout << "Enter new Role (Admin/Chef/Customer): ";
-        std::cin >> role;
-        if (role != "Admin" && role != "Chef" && role != "Customer") {
+        std::cin >> roleText;
+        Role role;
+        if (!parseRole(roleText, role)) {
             std::cout << "Invalid Role. Returning to main menu.\n";
             return;
         }
+        // No lock is held while prompting, so look the user up again
+        JournalSync sync(journal);
+        WriteLock write(userLock);
+        auto found = userIndex.find(userID);
+        if (found == userIndex.end()) {
+            std::cout << "User ID not found. Returning to main menu.\n";
+            return;
+        }
+        auto it = users.begin() + found->second;
+        auto owner = usernameIndex.find(username);
+        if (owner != usernameIndex.end() && owner->second != userID) {
+            std::cout << "Username already exists. Returning to main menu.\n";
+            return;
+        }
+        usernameIndex.erase(it->username);
+        usernameIndex[username] = userID;
         it->username = username;
         it->password = password;
         it->role = role;
+        refreshSessionsOf(userID, permissionsFor(role));
+        journalPut(JournalOp::PutUser, *it);
         std::cout << "User modified successfully.\n";
     }
 
     // Modify a material by its ID
-    void modifyMaterial(int materialID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void modifyMaterial(SessionToken session, int materialID) {
+        if (!allowed(session, ManageMaterials)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::find_if(materials.begin(), materials.end(), [&](const Material& m) { return m.materialID == materialID; });
-        if (it == materials.end()) {
+        if (!contains(materialLock, materialIndex, materialID)) {
             std::cout << "Material ID not found. Returning to main menu.\n";
             return;
         }
         std::string name;
-        double price;
+        Money price;
         int quantity, warningThreshold;
         std::cout << "Enter new Material Name: ";
         std::cin >> name;
@@ -495,26 +4447,57 @@ public:
         std::cin >> quantity;
         std::cout << "Enter new Warning Threshold: ";
         std::cin >> warningThreshold;
-        it->name = name;
-        it->price = price;
-        it->quantity = quantity;
-        it->warningThreshold = warningThreshold;
+        JournalSync sync(journal);
+        WriteLock dishWrite(dishLock);  // A price change updates the cached dish costs
+        WriteLock materialWrite(materialLock);
+        auto found = materialIndex.find(materialID);
+        if (found == materialIndex.end()) {
+            std::cout << "Material ID not found. Returning to main menu.\n";
+            return;
+        }
+        auto it = materials.begin() + found->second;
+        Money value;
+        if (!value.addWithinLimit(price, quantity) || !dishCostsFit(materialID, price)) {
+            std::cout << "Price or stock value is too large. Returning to main menu.\n";
+            return;
+        }
+        beginJournalBatch();
+        {
+            EpochClock::Commit commit(versionClock);  // The material and the dish costs it changes
+            applyMaterialDelta(it->price * it->quantity, price * quantity);
+            stockLevelIndex.erase(stockLevelKey(*it));
+            bool priceChanged = it->price != price;
+            it->name = name;
+            it->price = price;
+            it->quantity = quantity;
+            stockCounters[found->second]->quantity = quantity;
+            it->warningThreshold = warningThreshold;
+            it->revision++;
+            stockLevelIndex.insert(stockLevelKey(*it));
+            refreshServings(*it);
+            if (priceChanged) {
+                refreshDishCostsUsing(materialID);
+                publishMenu();  // The view holds copies of the dishes, including their cost
+            }
+            journalPut(JournalOp::PutMaterial, *it);
+            checkStockLevel(*it);
+        }
+        commitJournalBatch();
         std::cout << "Material modified successfully.\n";
     }
 
     // Modify a dish by its ID
-    void modifyDish(int dishID) {
-        if (loggedInUser == nullptr || (loggedInUser->getRole() != "Admin" && loggedInUser->getRole() != "Chef")) {
+    void modifyDish(SessionToken session, int dishID) {
+        if (!allowed(session, ManageDishes)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::find_if(dishes.begin(), dishes.end(), [&](const Dish& d) { return d.dishID == dishID; });
-        if (it == dishes.end()) {
+        if (!contains(dishLock, dishIndex, dishID)) {
             std::cout << "Dish ID not found. Returning to main menu.\n";
             return;
         }
         std::string name, category;
-        double price;
+        Money price;
         int numIngredients;
         std::cout << "Enter new Dish Name: ";
         std::cin >> name;
@@ -524,33 +4507,67 @@ public:
         std::cin >> category;
         std::cout << "Enter number of new ingredients: ";
         std::cin >> numIngredients;
-        std::vector<Material> ingredients;
+        std::vector<Ingredient> ingredients;
         for (int i = 0; i < numIngredients; ++i) {
-            int materialID;
+            int materialID, amount;
             std::cout << "Enter Material ID for ingredient " << (i + 1) << ": ";
             std::cin >> materialID;
             try {
-                ingredients.push_back(getMaterialByID(materialID));
+                getMaterialByID(materialID);
             } catch (const std::runtime_error& e) {
                 std::cout << e.what() << std::endl;
                 --i; // Retry this ingredient
+                continue;
             }
+            std::cout << "Enter amount per serving: ";
+            std::cin >> amount;
+            if (amount <= 0) {
+                std::cout << "Invalid amount" << std::endl;
+                --i; // Retry this ingredient
+                continue;
+            }
+            ingredients.push_back(Ingredient{materialID, amount});
+        }
+        JournalSync sync(journal);
+        WriteLock dishWrite(dishLock);
+        WriteLock materialWrite(materialLock);
+        auto found = dishIndex.find(dishID);
+        if (found == dishIndex.end()) {
+            std::cout << "Dish ID not found. Returning to main menu.\n";
+            return;
+        }
+        auto it = dishes.begin() + found->second;
+        auto owner = dishNameIndex.find(name);
+        if (owner != dishNameIndex.end() && owner->second != dishID) {
+            std::cout << "Dish Name already exists. Returning to main menu.\n";
+            return;
+        }
+        Money cost;
+        if (!price.withinLimit() || !ingredientCost(ingredients, cost)) {
+            std::cout << "Price or ingredient cost is too large. Returning to main menu.\n";
+            return;
         }
+        dishNameIndex.erase(it->name);
+        dishNameIndex[name] = dishID;
+        unlinkDish(*it);
         it->name = name;
         it->price = price;
         it->category = category;
         it->ingredients = ingredients;
+        linkDish(*it);
+        refreshDishCost(*it);
+        refreshServings();
+        journalPut(JournalOp::PutDish, *it);
         std::cout << "Dish modified successfully.\n";
     }
 
     // Modify a customer by its ID
-    void modifyCustomer(int customerID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void modifyCustomer(SessionToken session, int customerID) {
+        if (!allowed(session, ManageCustomers)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::find_if(customers.begin(), customers.end(), [&](const Customer& c) { return c.customerID == customerID; });
-        if (it == customers.end()) {
+        if (!contains(customerLock, customerIndex, customerID)) {
             std::cout << "Customer ID not found. Returning to main menu.\n";
             return;
         }
@@ -564,23 +4581,40 @@ public:
         std::cin >> points;
         std::cout << "Enter new Discount Info: ";
         std::cin >> discountInfo;
+        JournalSync sync(journal);
+        WriteLock write(customerLock);
+        auto found = customerIndex.find(customerID);
+        if (found == customerIndex.end()) {
+            std::cout << "Customer ID not found. Returning to main menu.\n";
+            return;
+        }
+        auto it = customers.begin() + found->second;
         it->name = name;
         it->contact = contact;
         it->points = points;
         it->discountInfo = discountInfo;
+        journalPut(JournalOp::PutCustomer, *it);
         std::cout << "Customer modified successfully.\n";
     }
 
     // Modify an order by its ID
-    void modifyOrder(int orderID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void modifyOrder(SessionToken session, int orderID) {
+        if (!allowed(session, ManageOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::find_if(orders.begin(), orders.end(), [&](const Order& o) { return o.orderID == orderID; });
-        if (it == orders.end()) {
-            std::cout << "Order ID not found. Returning to main menu.\n";
-            return;
+        OrderShard& shard = shardFor(orderID);
+        {
+            ReadLock read(shard.lock);
+            Order* order = findOrder(shard, orderID);
+            if (order == nullptr) {
+                std::cout << "Order ID not found. Returning to main menu.\n";
+                return;
+            }
+            if (!isModifiable(*order)) {
+                std::cout << "Only new, unpaid orders can be modified. Returning to main menu.\n";
+                return;
+            }
         }
         int customerID, numDishes;
         std::string paymentMethod;
@@ -588,13 +4622,13 @@ public:
         std::cin >> customerID;
         std::cout << "Enter number of new dishes: ";
         std::cin >> numDishes;
-        std::vector<Dish> dishes;
+        std::vector<OrderLine> lines;
         for (int i = 0; i < numDishes; ++i) {
             int dishID;
             std::cout << "Enter Dish ID for dish " << (i + 1) << ": ";
             std::cin >> dishID;
             try {
-                dishes.push_back(getDishByID(dishID));
+                addOrderLine(lines, getDishByID(dishID));
             } catch (const std::runtime_error& e) {
                 std::cout << e.what() << std::endl;
                 --i; // Retry this dish
@@ -602,21 +4636,60 @@ public:
         }
         std::cout << "Enter new Payment Method: ";
         std::cin >> paymentMethod;
-        it->customerID = customerID;
-        it->dishes = dishes;
-        it->paymentMethod = paymentMethod;
-        it->totalFee = it->calculateTotalFee();
+        JournalSync sync(journal);
+        ReadLock dishRead(dishLock);
+        ReadLock materialRead(materialLock);
+        WriteLock shardWrite(shard.lock);
+        Order* it = findOrder(shard, orderID);
+        if (it == nullptr) {
+            std::cout << "Order ID not found. Returning to main menu.\n";
+            return;
+        }
+        if (!isModifiable(*it)) {
+            std::cout << "Only new, unpaid orders can be modified. Returning to main menu.\n";
+            return;
+        }
+        Order modified = *it;
+        modified.lines = lines;
+        if (!modified.calculateTotalFee(modified.totalFee)) {
+            std::cout << "Order total is too large. Returning to main menu.\n";
+            return;
+        }
+        beginJournalBatch();
+        const char* error;
+        {
+            EpochClock::Commit commit(versionClock);  // The order and its stock change become visible together
+            error = reserveStock(lines, it->lines);
+            if (error == nullptr) {
+                Money oldFee = it->totalFee;
+                {
+                    std::lock_guard<std::mutex> tracking(orderTrackingLock);
+                    unlinkOrder(*it);
+                    it->customerID = customerID;
+                    it->lines = lines;
+                    it->paymentMethod = paymentMethod;
+                    it->totalFee = modified.totalFee;
+                    linkOrder(*it);
+                }
+                applyOrderDelta(oldFee, it->totalFee);
+                journalPut(JournalOp::PutOrder, *it);
+            }
+        }
+        commitJournalBatch();
+        if (error != nullptr) {
+            std::cout << error << " Returning to main menu.\n";
+            return;
+        }
         std::cout << "Order modified successfully.\n";
     }
 
     // Modify a notification by its ID
-    void modifyNotification(int notificationID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void modifyNotification(SessionToken session, int notificationID) {
+        if (!allowed(session, ManageNotifications)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::find_if(notifications.begin(), notifications.end(), [&](const Notification& n) { return n.notificationID == notificationID; });
-        if (it == notifications.end()) {
+        if (!contains(notificationLock, notificationIndex, notificationID)) {
             std::cout << "Notification ID not found. Returning to main menu.\n";
             return;
         }
@@ -627,107 +4700,281 @@ public:
         std::cin >> content;
         std::cout << "Enter new Notification Time: ";
         std::cin >> time;
+        JournalSync sync(journal);
+        WriteLock write(notificationLock);
+        auto found = notificationIndex.find(notificationID);
+        if (found == notificationIndex.end()) {
+            std::cout << "Notification ID not found. Returning to main menu.\n";
+            return;
+        }
+        auto it = notifications.begin() + found->second;
         it->type = type;
         it->content = content;
         it->time = time;
+        journalPut(JournalOp::PutNotification, *it);
         std::cout << "Notification modified successfully.\n";
     }
 
     // Delete a user by its ID
-    void deleteUser(int userID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void deleteUser(SessionToken session, int userID) {
+        if (!allowed(session, ManageUsers)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::remove_if(users.begin(), users.end(), [&](const User& u) { return u.userID == userID; });
-        if (it == users.end()) {
+        JournalSync sync(journal);
+        WriteLock write(userLock);
+        auto found = userIndex.find(userID);
+        if (found == userIndex.end()) {
             std::cout << "User ID not found. Returning to main menu.\n";
             return;
         }
-        users.erase(it, users.end());
+        size_t slot = found->second;
+        usernameIndex.erase(users[slot].username);
+        eraseSlot(users, userIndex, slot, [](const User& u) { return u.userID; });
+        refreshSessionsOf(userID, 0);  // Log the user out everywhere
+        journalErase(JournalOp::EraseUser, userID);
         std::cout << "User deleted successfully.\n";
     }
 
     // Delete a material by its ID
-    void deleteMaterial(int materialID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void deleteMaterial(SessionToken session, int materialID) {
+        if (!allowed(session, ManageMaterials)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::remove_if(materials.begin(), materials.end(), [&](const Material& m) { return m.materialID == materialID; });
-        if (it == materials.end()) {
+        JournalSync sync(journal);
+        size_t usedBy = 0;
+        {
+            ReadLock dishRead(dishLock);
+            ReadLock materialRead(materialLock);
+            if (!materialIndex.count(materialID)) {
+                std::cout << "Material ID not found. Returning to main menu.\n";
+                return;
+            }
+            auto usage = dishesByMaterial.find(materialID);
+            usedBy = usage == dishesByMaterial.end() ? 0 : usage->second.size();
+        }
+        bool cascade = false;
+        if (usedBy > 0) {
+            char answer;
+            std::cout << "Material is used by " << usedBy << " dishes. Remove it from those dishes? (y/n): ";
+            std::cin >> answer;
+            cascade = answer == 'y' || answer == 'Y';
+            if (!cascade) {
+                std::cout << "Material is in use. Returning to main menu.\n";
+                return;
+            }
+        }
+        WriteLock dishWrite(dishLock);
+        WriteLock materialWrite(materialLock);
+        auto found = materialIndex.find(materialID);
+        if (found == materialIndex.end()) {
             std::cout << "Material ID not found. Returning to main menu.\n";
             return;
         }
-        materials.erase(it, materials.end());
+        auto usage = dishesByMaterial.find(materialID);
+        if (usage != dishesByMaterial.end() && !cascade) {
+            // A dish started using it while the user was answering
+            std::cout << "Material is in use. Returning to main menu.\n";
+            return;
+        }
+        beginJournalBatch();
+        {
+            EpochClock::Commit commit(versionClock);  // The material leaves the dishes and the stock together
+            if (usage != dishesByMaterial.end()) {
+                // Cascade: drop the material from only the dishes that use it
+                std::vector<int> dependents = usage->second;
+                for (int dishID : dependents) {
+                    Dish& dish = dishes[dishIndex.at(dishID)];
+                    unlinkDish(dish);
+                    dish.ingredients.erase(std::remove_if(dish.ingredients.begin(), dish.ingredients.end(),
+                                                          [&](const Ingredient& ingredient) { return ingredient.materialID == materialID; }),
+                                           dish.ingredients.end());
+                    linkDish(dish);
+                    refreshDishCost(dish);
+                    journalPut(JournalOp::PutDish, dish);
+                }
+            }
+            const Material& material = materials[found->second];
+            applyMaterialDelta(material.price * material.quantity, Money());
+            stockLevelIndex.erase(stockLevelKey(material));
+            stockCounters[found->second] = std::move(stockCounters.back());  // Mirror the move eraseSlot makes
+            stockCounters.pop_back();
+            eraseSlot(materials, materialIndex, found->second, [](const Material& m) { return m.materialID; });
+            refreshServings();
+            journalErase(JournalOp::EraseMaterial, materialID);
+        }
+        commitJournalBatch();
         std::cout << "Material deleted successfully.\n";
     }
 
     // Delete a dish by its ID
-    void deleteDish(int dishID) {
-        if (loggedInUser == nullptr || (loggedInUser->getRole() != "Admin" && loggedInUser->getRole() != "Chef")) {
+    void deleteDish(SessionToken session, int dishID) {
+        if (!allowed(session, ManageDishes)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::remove_if(dishes.begin(), dishes.end(), [&](const Dish& d) { return d.dishID == dishID; });
-        if (it == dishes.end()) {
+        JournalSync sync(journal);
+        WriteLock dishWrite(dishLock);
+        WriteLock materialWrite(materialLock);  // The servings table is indexed by dish slot
+        auto found = dishIndex.find(dishID);
+        if (found == dishIndex.end()) {
             std::cout << "Dish ID not found. Returning to main menu.\n";
             return;
         }
-        dishes.erase(it, dishes.end());
+        dishNameIndex.erase(dishes[found->second].name);
+        unlinkDish(dishes[found->second]);
+        eraseSlot(dishes, dishIndex, found->second, [](const Dish& d) { return d.dishID; });
+        refreshServings();
+        journalErase(JournalOp::EraseDish, dishID);
         std::cout << "Dish deleted successfully.\n";
     }
 
     // Delete a customer by its ID
-    void deleteCustomer(int customerID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void deleteCustomer(SessionToken session, int customerID) {
+        if (!allowed(session, ManageCustomers)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::remove_if(customers.begin(), customers.end(), [&](const Customer& c) { return c.customerID == customerID; });
-        if (it == customers.end()) {
+        JournalSync sync(journal);
+        WriteLock write(customerLock);
+        auto found = customerIndex.find(customerID);
+        if (found == customerIndex.end()) {
             std::cout << "Customer ID not found. Returning to main menu.\n";
             return;
         }
-        customers.erase(it, customers.end());
+        eraseSlot(customers, customerIndex, found->second, [](const Customer& c) { return c.customerID; });
+        journalErase(JournalOp::EraseCustomer, customerID);
         std::cout << "Customer deleted successfully.\n";
     }
 
     // Delete an order by its ID
-    void deleteOrder(int orderID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void deleteOrder(SessionToken session, int orderID) {
+        if (!allowed(session, ManageOrders)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::remove_if(orders.begin(), orders.end(), [&](const Order& o) { return o.orderID == orderID; });
-        if (it == orders.end()) {
+        JournalSync sync(journal);
+        ReadLock dishRead(dishLock);
+        ReadLock materialRead(materialLock);  // Stock is returned through the counters
+        OrderShard& shard = shardFor(orderID);
+        WriteLock write(shard.lock);
+        auto found = shard.index.find(orderID);
+        if (found == shard.index.end()) {
             std::cout << "Order ID not found. Returning to main menu.\n";
             return;
         }
-        orders.erase(it, orders.end());
+        const Order& order = shard.orders[found->second];
+        beginJournalBatch();
+        {
+            EpochClock::Commit commit(versionClock);  // The order leaves with the stock it gives back
+            if (order.status != OrderStatus::Completed) {
+                reserveStock({}, order.lines);  // Give back what the order reserved; served dishes are used up
+            }
+            {
+                std::lock_guard<std::mutex> tracking(orderTrackingLock);
+                unlinkOrder(order);
+                prepTasksLeft.erase(orderID);
+            }
+            applyOrderDelta(order.totalFee, Money());
+            eraseSlot(shard.orders, shard.index, found->second, [](const Order& o) { return o.orderID; });
+            journalErase(JournalOp::EraseOrder, orderID);
+        }
+        commitJournalBatch();
         std::cout << "Order deleted successfully.\n";
     }
 
     // Delete a notification by its ID
-    void deleteNotification(int notificationID) {
-        if (loggedInUser == nullptr || loggedInUser->getRole() != "Admin") {
+    void deleteNotification(SessionToken session, int notificationID) {
+        if (!allowed(session, ManageNotifications)) {
             std::cout << "Permission denied.\n";
             return;
         }
-        auto it = std::remove_if(notifications.begin(), notifications.end(), [&](const Notification& n) { return n.notificationID == notificationID; });
-        if (it == notifications.end()) {
+        JournalSync sync(journal);
+        WriteLock write(notificationLock);
+        auto found = notificationIndex.find(notificationID);
+        if (found == notificationIndex.end()) {
             std::cout << "Notification ID not found. Returning to main menu.\n";
             return;
         }
-        notifications.erase(it, notifications.end());
+        eraseSlot(notifications, notificationIndex, found->second, [](const Notification& n) { return n.notificationID; });
+        journalErase(JournalOp::EraseNotification, notificationID);
         std::cout << "Notification deleted successfully.\n";
     }
 };
 
-int main() {
+#ifndef RMS_NO_MAIN  // Defined by benchmark.cpp, which includes this file
+int main(int argc, char* argv[]) {
     RestaurantManagementSystem rms;
     int choice;
 
+    std::string snapshotPath = "restaurant.snapshot";
+    Durability durability = Durability::Batched;
+    int stationsPerKind = 1;
+    int prepMillis = 0;
+    int batchWindowMillis = 0;
+    int maxBatchServings = 8;
+    int intakeCapacity = 0;
+    Backpressure whenIntakeFull = Backpressure::Block;
+
+    // Command line options
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--verify-finance") == 0) {
+            rms.setFinanceVerification(true);
+        } else if (std::strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshotPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--durability") == 0 && i + 1 < argc) {
+            if (!parseDurability(argv[++i], durability)) {
+                std::cout << "Unknown durability level, expected every, batched or buffered.\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--stations") == 0 && i + 1 < argc) {
+            if (!parseInt(argv[++i], stationsPerKind) || stationsPerKind < 1) {
+                std::cout << "Expected a positive number of stations per kind.\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--prep-ms") == 0 && i + 1 < argc) {
+            if (!parseInt(argv[++i], prepMillis) || prepMillis < 0) {
+                std::cout << "Expected a prep time in milliseconds.\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--batch-window-ms") == 0 && i + 1 < argc) {
+            if (!parseInt(argv[++i], batchWindowMillis) || batchWindowMillis < 0) {
+                std::cout << "Expected a batch window in milliseconds.\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--batch-size") == 0 && i + 1 < argc) {
+            if (!parseInt(argv[++i], maxBatchServings) || maxBatchServings < 1) {
+                std::cout << "Expected a positive number of servings per batch.\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--intake-capacity") == 0 && i + 1 < argc) {
+            if (!parseInt(argv[++i], intakeCapacity) || intakeCapacity < 0) {
+                std::cout << "Expected an intake capacity, or 0 to place orders directly.\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--intake-when-full") == 0 && i + 1 < argc) {
+            if (!parseBackpressure(argv[++i], whenIntakeFull)) {
+                std::cout << "Unknown backpressure policy, expected block or reject.\n";
+                return 1;
+            }
+        }
+    }
+
+    // Restore the state saved by the previous run, then the mutations journaled after it
+    if (rms.loadSnapshot(snapshotPath)) {
+        std::cout << "Loaded snapshot " << snapshotPath << ".\n";
+    }
+    size_t replayed = rms.openJournal(snapshotPath + ".journal", durability);
+    if (replayed > 0) {
+        std::cout << "Replayed " << replayed << " journal records.\n";
+    }
+    rms.startKitchen(stationsPerKind, std::chrono::milliseconds(prepMillis),
+                     std::chrono::milliseconds(batchWindowMillis), maxBatchServings);
+    if (intakeCapacity > 0) {
+        rms.startIntake(static_cast<size_t>(intakeCapacity), whenIntakeFull);
+    }
+
     // Main menu loop
     do {
         std::cout << "\n************************************\n";
@@ -749,7 +4996,7 @@ int main() {
         switch (choice) {
             case 1: {
                 int id;
-                std::string username, password, role;
+                std::string username, password, roleText;
                 std::cout << "Enter User ID: ";
                 std::cin >> id;
                 if (std::cin.fail()) {
@@ -763,8 +5010,9 @@ int main() {
                 std::cout << "Enter Password: ";
                 std::cin >> password;
                 std::cout << "Enter Role (Admin/Chef/Customer): ";
-                std::cin >> role;
-                if (role != "Admin" && role != "Chef" && role != "Customer") {
+                std::cin >> roleText;
+                Role role;
+                if (!parseRole(roleText, role)) {
                     std::cout << "Invalid Role. Returning to main menu.\n";
                     break;
                 }
@@ -777,7 +5025,8 @@ int main() {
                 std::cin >> username;
                 std::cout << "Enter Password: ";
                 std::cin >> password;
-                if (rms.login(username, password)) {
+                SessionToken session = rms.login(username, password);
+                if (session != NO_SESSION) {
                     int userChoice;
                     // User menu loop
                     do {
@@ -789,6 +5038,8 @@ int main() {
                         std::cout << "4. Display\n";
                         std::cout << "5. Calculate Finance\n";
                         std::cout << "6. Check out\n";
+                        std::cout << "7. Save Snapshot\n";
+                        std::cout << "8. Kitchen\n";
                         std::cout << "0. Logout\n";
                         std::cout << "Enter your choice: ";
                         std::cin >> userChoice;
@@ -812,6 +5063,7 @@ int main() {
                                 std::cout << "4. Add Customer\n";
                                 std::cout << "5. Add Order\n";
                                 std::cout << "6. Add Notification\n";
+                                std::cout << "7. Bulk Import (CSV)\n";
                                 std::cout << "0. Back\n";
                                 std::cout << "Enter your choice: ";
                                 std::cin >> addChoice;
@@ -820,7 +5072,7 @@ int main() {
                                 switch (addChoice) {
                                     case 1: {
                                         int id;
-                                        std::string username, password, role;
+                                        std::string username, password, roleText;
                                         std::cout << "Enter User ID: ";
                                         std::cin >> id;
                                         if (std::cin.fail()) {
@@ -834,19 +5086,20 @@ int main() {
                                         std::cout << "Enter Password: ";
                                         std::cin >> password;
                                         std::cout << "Enter Role (Admin/Chef/Customer): ";
-                                        std::cin >> role;
-                                        if (role != "Admin" && role != "Chef" && role != "Customer") {
+                                        std::cin >> roleText;
+                                        Role role;
+                                        if (!parseRole(roleText, role)) {
                                             std::cout << "Invalid Role. Returning to add menu.\n";
                                             break;
                                         }
-                                        rms.addUser(User(id, username, password, role));
+                                        rms.addUser(session, User(id, username, password, role));
                                         std::cout << "User added successfully.\n";
                                         break;
                                     }
                                     case 2: {
                                         int id, quantity, warningThreshold;
                                         std::string name;
-                                        double price;
+                                        Money price;
                                         std::cout << "Enter Material ID: ";
                                         std::cin >> id;
                                         if (std::cin.fail()) {
@@ -881,14 +5134,14 @@ int main() {
                                             std::cout << "Invalid Warning Threshold. Returning to add menu.\n";
                                             break;
                                         }
-                                        rms.addMaterial(Material(id, name, price, quantity, warningThreshold));
+                                        rms.addMaterial(session, Material(id, name, price, quantity, warningThreshold));
                                         std::cout << "Material added successfully.\n";
                                         break;
                                     }
                                     case 3: {
                                         int id, numIngredients;
                                         std::string name, category;
-                                        double price;
+                                        Money price;
                                         std::cout << "Enter Dish ID: ";
                                         std::cin >> id;
                                         if (std::cin.fail()) {
@@ -917,9 +5170,9 @@ int main() {
                                             std::cout << "Invalid number of ingredients. Returning to add menu.\n";
                                             break;
                                         }
-                                        std::vector<Material> ingredients;
+                                        std::vector<Ingredient> ingredients;
                                         for (int i = 0; i < numIngredients; ++i) {
-                                            int materialID;
+                                            int materialID, amount;
                                             std::cout << "Enter Material ID for ingredient " << (i + 1) << ": ";
                                             std::cin >> materialID;
                                             if (std::cin.fail()) {
@@ -930,14 +5183,25 @@ int main() {
                                                 break;
                                             }
                                             try {
-                                                ingredients.push_back(rms.getMaterialByID(materialID));
+                                                rms.getMaterialByID(materialID);
                                             } catch (const std::runtime_error& e) {
                                                 std::cout << e.what() << std::endl;
                                                 --i; // Retry this ingredient
+                                                continue;
+                                            }
+                                            std::cout << "Enter amount per serving: ";
+                                            std::cin >> amount;
+                                            if (std::cin.fail() || amount <= 0) {
+                                                std::cin.clear();
+                                                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                                                std::cout << "Invalid amount. Returning to add menu.\n";
+                                                ingredients.clear();
+                                                break;
                                             }
+                                            ingredients.push_back(Ingredient{materialID, amount});
                                         }
                                         if (!ingredients.empty()) {
-                                            rms.addDish(Dish(id, name, price, category, ingredients));
+                                            rms.addDish(session, Dish(id, name, price, category, ingredients));
                                             std::cout << "Dish added successfully.\n";
                                         }
                                         break;
@@ -967,7 +5231,7 @@ int main() {
                                         }
                                         std::cout << "Enter Discount Info: ";
                                         std::cin >> discountInfo;
-                                        rms.addCustomer(Customer(id, name, contact, points, discountInfo));
+                                        rms.addCustomer(session, Customer(id, name, contact, points, discountInfo));
                                         std::cout << "Customer added successfully.\n";
                                         break;
                                     }
@@ -998,7 +5262,7 @@ int main() {
                                             std::cout << "Invalid number of dishes. Returning to add menu.\n";
                                             break;
                                         }
-                                        std::vector<Dish> dishes;
+                                        std::vector<OrderLine> lines;
                                         for (int i = 0; i < numDishes; ++i) {
                                             int dishID;
                                             std::cout << "Enter Dish ID for dish " << (i + 1) << ": ";
@@ -1007,21 +5271,30 @@ int main() {
                                                 std::cin.clear();
                                                 std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
                                                 std::cout << "Invalid Dish ID. Returning to add menu.\n";
-                                                dishes.clear();
+                                                lines.clear();
                                                 break;
                                             }
                                             try {
-                                                dishes.push_back(rms.getDishByID(dishID));
+                                                addOrderLine(lines, rms.getAvailableDish(dishID));
                                             } catch (const std::runtime_error& e) {
                                                 std::cout << e.what() << std::endl;
                                                 --i; // Retry this dish
                                             }
                                         }
-                                        if (!dishes.empty()) {
+                                        if (!lines.empty()) {
                                             std::cout << "Enter Payment Method: ";
                                             std::cin >> paymentMethod;
-                                            rms.addOrder(Order(id, customerID, dishes, paymentMethod));
-                                            std::cout << "Order added successfully.\n";
+                                            if (intakeCapacity > 0) {
+                                                // Wait for the committer, like any other terminal
+                                                const char* error = rms.submitOrder(session, Order(id, customerID, lines, paymentMethod)).get();
+                                                if (error) {
+                                                    std::cout << error << " Order rejected.\n";
+                                                } else {
+                                                    std::cout << "Order added successfully.\n";
+                                                }
+                                            } else {
+                                                rms.addOrder(session, Order(id, customerID, lines, paymentMethod));
+                                            }
                                         }
                                         break;
                                     }
@@ -1042,10 +5315,19 @@ int main() {
                                         std::cin >> content;
                                         std::cout << "Enter Notification Time: ";
                                         std::cin >> time;
-                                        rms.addNotification(Notification(id, type, content, time));
+                                        rms.addNotification(session, Notification(id, type, content, time));
                                         std::cout << "Notification added successfully.\n";
                                         break;
                                     }
+                                    case 7: {
+                                        std::string kind, path;
+                                        std::cout << "Enter type to import (materials/dishes/customers/users): ";
+                                        std::cin >> kind;
+                                        std::cout << "Enter CSV file path: ";
+                                        std::cin >> path;
+                                        rms.importCSV(session, kind, path);
+                                        break;
+                                    }
                                     case 0:
                                         std::cout << "Returning to add menu.\n";
                                         break;
@@ -1073,42 +5355,42 @@ int main() {
                                         int userID;
                                         std::cout << "Enter User ID to modify: ";
                                         std::cin >> userID;
-                                        rms.modifyUser(userID);
+                                        rms.modifyUser(session, userID);
                                         break;
                                     }
                                     case 2: {
                                         int materialID;
                                         std::cout << "Enter Material ID to modify: ";
                                         std::cin >> materialID;
-                                        rms.modifyMaterial(materialID);
+                                        rms.modifyMaterial(session, materialID);
                                         break;
                                     }
                                     case 3: {
                                         int dishID;
                                         std::cout << "Enter Dish ID to modify: ";
                                         std::cin >> dishID;
-                                        rms.modifyDish(dishID);
+                                        rms.modifyDish(session, dishID);
                                         break;
                                     }
                                     case 4: {
                                         int customerID;
                                         std::cout << "Enter Customer ID to modify: ";
                                         std::cin >> customerID;
-                                        rms.modifyCustomer(customerID);
+                                        rms.modifyCustomer(session, customerID);
                                         break;
                                     }
                                     case 5: {
                                         int orderID;
                                         std::cout << "Enter Order ID to modify: ";
                                         std::cin >> orderID;
-                                        rms.modifyOrder(orderID);
+                                        rms.modifyOrder(session, orderID);
                                         break;
                                     }
                                     case 6: {
                                         int notificationID;
                                         std::cout << "Enter Notification ID to modify: ";
                                         std::cin >> notificationID;
-                                        rms.modifyNotification(notificationID);
+                                        rms.modifyNotification(session, notificationID);
                                         break;
                                     }
                                     case 0:
@@ -1138,42 +5420,42 @@ int main() {
                                         int userID;
                                         std::cout << "Enter User ID to delete: ";
                                         std::cin >> userID;
-                                        rms.deleteUser(userID);
+                                        rms.deleteUser(session, userID);
                                         break;
                                     }
                                     case 2: {
                                         int materialID;
                                         std::cout << "Enter Material ID to delete: ";
                                         std::cin >> materialID;
-                                        rms.deleteMaterial(materialID);
+                                        rms.deleteMaterial(session, materialID);
                                         break;
                                     }
                                     case 3: {
                                         int dishID;
                                         std::cout << "Enter Dish ID to delete: ";
                                         std::cin >> dishID;
-                                        rms.deleteDish(dishID);
+                                        rms.deleteDish(session, dishID);
                                         break;
                                     }
                                     case 4: {
                                         int customerID;
                                         std::cout << "Enter Customer ID to delete: ";
                                         std::cin >> customerID;
-                                        rms.deleteCustomer(customerID);
+                                        rms.deleteCustomer(session, customerID);
                                         break;
                                     }
                                     case 5: {
                                         int orderID;
                                         std::cout << "Enter Order ID to delete: ";
                                         std::cin >> orderID;
-                                        rms.deleteOrder(orderID);
+                                        rms.deleteOrder(session, orderID);
                                         break;
                                     }
                                     case 6: {
                                         int notificationID;
                                         std::cout << "Enter Notification ID to delete: ";
                                         std::cin >> notificationID;
-                                        rms.deleteNotification(notificationID);
+                                        rms.deleteNotification(session, notificationID);
                                         break;
                                     }
                                     case 0:
@@ -1193,6 +5475,10 @@ int main() {
                                 std::cout << "4. Display Customers\n";
                                 std::cout << "5. Display Orders\n";
                                 std::cout << "6. Display Notifications\n";
+                                std::cout << "7. Display Reorder List\n";
+                                std::cout << "8. Display Dishes Using Material\n";
+                                std::cout << "9. Display Menu Profitability\n";
+                                std::cout << "10. Display Servings Available\n";
                                 std::cout << "0. Back\n";
                                 std::cout << "Enter your choice: ";
                                 std::cin >> displayChoice;
@@ -1200,22 +5486,54 @@ int main() {
                                 // Display menu switch case
                                 switch (displayChoice) {
                                     case 1:
-                                        rms.displayUsers();
+                                        rms.displayUsers(session);
                                         break;
                                     case 2:
-                                        rms.displayMaterials();
+                                        rms.displayMaterials(session);
                                         break;
                                     case 3:
-                                        rms.displayDishes();
+                                        rms.displayDishes(session);
                                         break;
                                     case 4:
-                                        rms.displayCustomers();
+                                        rms.displayCustomers(session);
                                         break;
                                     case 5:
-                                        rms.displayOrders();
+                                        rms.displayOrders(session);
                                         break;
                                     case 6:
-                                        rms.displayNotifications();
+                                        rms.displayNotifications(session);
+                                        break;
+                                    case 7: {
+                                        int count;
+                                        std::cout << "Enter number of materials to show: ";
+                                        std::cin >> count;
+                                        if (std::cin.fail()) {
+                                            std::cin.clear();
+                                            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                                            std::cout << "Invalid number. Returning to display menu.\n";
+                                            break;
+                                        }
+                                        rms.displayReorderList(session, count);
+                                        break;
+                                    }
+                                    case 8: {
+                                        int materialID;
+                                        std::cout << "Enter Material ID: ";
+                                        std::cin >> materialID;
+                                        if (std::cin.fail()) {
+                                            std::cin.clear();
+                                            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                                            std::cout << "Invalid Material ID. Returning to display menu.\n";
+                                            break;
+                                        }
+                                        rms.displayDishesUsingMaterial(session, materialID);
+                                        break;
+                                    }
+                                    case 9:
+                                        rms.displayMenuProfitability(session);
+                                        break;
+                                    case 10:
+                                        rms.displayServingsAvailable(session);
                                         break;
                                     case 0:
                                         std::cout << "Returning to display menu.\n";
@@ -1226,12 +5544,92 @@ int main() {
                                 break;
                             }
                             case 5:
-                                rms.calculateFinance();
+                                rms.calculateFinance(session);
+                                break;
+                            case 6: {
+                                int customerID;
+                                std::cout << "Enter Customer ID: ";
+                                std::cin >> customerID;
+                                if (std::cin.fail()) {
+                                    std::cin.clear();
+                                    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                                    std::cout << "Invalid Customer ID. Returning to main menu.\n";
+                                    break;
+                                }
+                                rms.checkout(session, customerID);
                                 break;
-                            case 6:
-                                rms.displayTotalFee();
+                            }
+                            case 7:
+                                rms.saveSnapshotAs(session, snapshotPath);
+                                break;
+                            case 8: {
+                                int kitchenChoice;
+                                std::cout << "\nKitchen Menu\n";
+                                std::cout << "1. Display Kitchen Queue\n";
+                                std::cout << "2. Start Next Order\n";
+                                std::cout << "3. Update Order Status\n";
+                                std::cout << "4. Set Order Priority\n";
+                                std::cout << "5. Display Stations\n";
+                                std::cout << "6. Display Batching Stats\n";
+                                std::cout << "0. Back\n";
+                                std::cout << "Enter your choice: ";
+                                std::cin >> kitchenChoice;
+
+                                // Kitchen menu switch case
+                                switch (kitchenChoice) {
+                                    case 1:
+                                        rms.displayKitchenQueue(session);
+                                        break;
+                                    case 2:
+                                        rms.startNextOrder(session);
+                                        break;
+                                    case 3: {
+                                        int orderID;
+                                        std::string status;
+                                        std::cout << "Enter Order ID: ";
+                                        std::cin >> orderID;
+                                        if (std::cin.fail()) {
+                                            std::cin.clear();
+                                            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                                            std::cout << "Invalid Order ID. Returning to kitchen menu.\n";
+                                            break;
+                                        }
+                                        std::cout << "Enter new Status (New, InPreparation, Completed): ";
+                                        std::cin >> status;
+                                        rms.updateOrderStatus(session, orderID, status);
+                                        break;
+                                    }
+                                    case 4: {
+                                        int orderID, priority;
+                                        std::cout << "Enter Order ID: ";
+                                        std::cin >> orderID;
+                                        std::cout << "Enter Priority (higher is prepared first): ";
+                                        std::cin >> priority;
+                                        if (std::cin.fail()) {
+                                            std::cin.clear();
+                                            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                                            std::cout << "Invalid input. Returning to kitchen menu.\n";
+                                            break;
+                                        }
+                                        rms.setOrderPriority(session, orderID, priority);
+                                        break;
+                                    }
+                                    case 5:
+                                        rms.displayStations(session);
+                                        break;
+                                    case 6:
+                                        rms.displayBatchingStats(session);
+                                        break;
+                                    case 0:
+                                        std::cout << "Returning to main menu.\n";
+                                        break;
+                                    default:
+                                        std::cout << "Invalid choice, returning to main menu.\n";
+                                }
                                 break;
+                            }
                             case 0:
+                                rms.logout(session);
                                 std::cout << "Logging out.\n";
                                 break;
                             default:
@@ -1244,6 +5642,7 @@ int main() {
                 break;
             }
             case 0:
+                rms.saveSnapshot(snapshotPath);
                 std::cout << "Exiting the system.\n";
                 break;
             default:
@@ -1253,3 +5652,4 @@ int main() {
 
     return 0;
 }
+#endif